@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include "dispatcher.h"
+#include "scheduler.h"
+#include "simulator.h"
+#include "job.h"
+
+// Called when a job completes at a backend queue
+// q - dispatcher queue
+// job - job that is being completed
+static void dispatcherQueueCompletionCallback(void* q, job_t* job)
+{
+    dispatcher_queue_t* queue = (dispatcher_queue_t*)q;
+    dispatcher_t* dispatcher = queue->dispatcher;
+    if (dispatcher->partitions) {
+        // Only the thread running this queue's simulator touches its partition
+        if (queue->completed++ == 0) {
+            dispatcher_partition_t* partition = &dispatcher->partitions[queue->index % dispatcher->numPartitions];
+            partition->updated[partition->numUpdated++] = queue->index;
+        }
+    } else {
+        queue->length--;
+        dispatcher->queueUpdate(dispatcher->routerInfo, dispatcher, queue->index);
+    }
+    dispatcher->completionCallback(dispatcher->completionCallbackData, job, simulatorSimTime(queue->scheduler->sim));
+}
+
+// Initializes routing policy options to their defaults
+void routerOptionsInit(router_options_t* options)
+{
+    options->d = 2;
+    options->cutoffs = NULL;
+    options->numCutoffs = 0;
+    options->seed = 1;
+}
+
+// Creates a dispatcher in front of numQueues queues sharing one simulator
+// routerName - name of routing policy
+// schedulerName - name of scheduler run by every queue, or NULL to only route jobs
+// numQueues - number of backend queues
+// sims - simulators, queue i uses sims[i % numSims]
+// numSims - number of simulators
+// options - routing policy options
+// completionCallback - function to call upon job completion
+// completionCallbackData - data to pass to completionCallback
+// Returns dispatcher on success or NULL otherwise
+dispatcher_t* dispatcherCreate(const char* routerName, const char* schedulerName, size_t numQueues, simulator_t** sims, size_t numSims, const router_options_t* options, dispatcherCompletionCallback_fn completionCallback, void* completionCallbackData)
+{
+    if (numQueues == 0 || (schedulerName && numSims == 0)) {
+        return NULL;
+    }
+    dispatcher_t* dispatcher = malloc(sizeof(dispatcher_t));
+    if (dispatcher == NULL) {
+        return NULL;
+    }
+    dispatcher->usesQueueLengths = false;
+    if (strcmp(routerName, "RANDOM") == 0) {
+        INIT_ROUTER(dispatcher, Random);
+    } else if (strcmp(routerName, "RR") == 0) {
+        INIT_ROUTER(dispatcher, RR);
+    } else if (strcmp(routerName, "JSQ") == 0) {
+        INIT_ROUTER(dispatcher, JSQ);
+        dispatcher->usesQueueLengths = true;
+    } else if (strcmp(routerName, "POD") == 0) {
+        INIT_ROUTER(dispatcher, PowerOfD);
+        dispatcher->usesQueueLengths = true;
+    } else if (strcmp(routerName, "SITA") == 0) {
+        INIT_ROUTER(dispatcher, SITA);
+    } else {
+        printf("Invalid router type: %s\n", routerName);
+        free(dispatcher);
+        return NULL;
+    }
+    dispatcher->numQueues = numQueues;
+    dispatcher->partitions = NULL;
+    dispatcher->numPartitions = numSims;
+    dispatcher->random = options->seed ? options->seed : 1;
+    dispatcher->completionCallback = completionCallback;
+    dispatcher->completionCallbackData = completionCallbackData;
+    dispatcher->queues = calloc(numQueues, sizeof(dispatcher_queue_t));
+    if (dispatcher->queues == NULL) {
+        free(dispatcher);
+        return NULL;
+    }
+    for (size_t i = 0; i < numQueues; i++) {
+        dispatcher_queue_t* queue = &dispatcher->queues[i];
+        queue->dispatcher = dispatcher;
+        queue->index = i;
+        queue->length = 0;
+        queue->completed = 0;
+        queue->scheduler = NULL;
+        if (schedulerName == NULL) {
+            continue;
+        }
+        queue->scheduler = schedulerCreate(schedulerName, sims[i % numSims], dispatcherQueueCompletionCallback, queue);
+        if (queue->scheduler == NULL) {
+            dispatcher->numQueues = i;
+            dispatcher->routerInfo = NULL;
+            dispatcherDestroy(dispatcher);
+            return NULL;
+        }
+    }
+    dispatcher->routerInfo = dispatcher->create(dispatcher, options);
+    if (dispatcher->routerInfo == NULL) {
+        dispatcherDestroy(dispatcher);
+        return NULL;
+    }
+    return dispatcher;
+}
+
+// Destroys a dispatcher and its queues
+void dispatcherDestroy(dispatcher_t* dispatcher)
+{
+    for (size_t i = 0; i < dispatcher->numQueues; i++) {
+        if (dispatcher->queues[i].scheduler) {
+            schedulerDestroy(dispatcher->queues[i].scheduler);
+        }
+    }
+    if (dispatcher->routerInfo) {
+        dispatcher->destroy(dispatcher->routerInfo);
+    }
+    if (dispatcher->partitions) {
+        for (size_t i = 0; i < dispatcher->numPartitions; i++) {
+            free(dispatcher->partitions[i].updated);
+        }
+        free(dispatcher->partitions);
+    }
+    free(dispatcher->queues);
+    free(dispatcher);
+}
+
+// Defers queue length updates caused by completions until dispatcherApplyUpdates
+// Queues in different simulators may then complete jobs from different threads
+// Returns true on success, false otherwise
+bool dispatcherDeferUpdates(dispatcher_t* dispatcher)
+{
+    if (dispatcher->partitions) {
+        return true;
+    }
+    dispatcher->partitions = calloc(dispatcher->numPartitions, sizeof(dispatcher_partition_t));
+    if (dispatcher->partitions == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < dispatcher->numPartitions; i++) {
+        // Queues i, i + numPartitions, ... share partition i
+        size_t capacity = (dispatcher->numQueues + dispatcher->numPartitions - 1 - i) / dispatcher->numPartitions;
+        dispatcher->partitions[i].updated = malloc((capacity ? capacity : 1) * sizeof(size_t));
+        dispatcher->partitions[i].numUpdated = 0;
+        if (dispatcher->partitions[i].updated == NULL) {
+            for (size_t j = 0; j < i; j++) {
+                free(dispatcher->partitions[j].updated);
+            }
+            free(dispatcher->partitions);
+            dispatcher->partitions = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Applies deferred queue length updates
+// Must not run concurrently with the simulators of the queues
+void dispatcherApplyUpdates(dispatcher_t* dispatcher)
+{
+    if (dispatcher->partitions == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < dispatcher->numPartitions; i++) {
+        dispatcher_partition_t* partition = &dispatcher->partitions[i];
+        for (size_t j = 0; j < partition->numUpdated; j++) {
+            dispatcher_queue_t* queue = &dispatcher->queues[partition->updated[j]];
+            queue->length -= queue->completed;
+            queue->completed = 0;
+            dispatcher->queueUpdate(dispatcher->routerInfo, dispatcher, queue->index);
+        }
+        partition->numUpdated = 0;
+    }
+}
+
+// Routes a job to a queue without scheduling it
+// Returns the index of the chosen queue
+size_t dispatcherRouteJob(dispatcher_t* dispatcher, job_t* job)
+{
+    size_t queue = dispatcher->routeJob(dispatcher->routerInfo, dispatcher, job);
+    return queue < dispatcher->numQueues ? queue : dispatcher->numQueues - 1;
+}
+
+// Schedules a routed job at its queue
+void dispatcherDeliverJob(dispatcher_t* dispatcher, size_t queue, job_t* job)
+{
+    dispatcher->queues[queue].length++;
+    dispatcher->queueUpdate(dispatcher->routerInfo, dispatcher, queue);
+    schedulerScheduleJob(dispatcher->queues[queue].scheduler, job);
+}
+
+// Sets the number of jobs at a queue that is simulated outside of the dispatcher
+void dispatcherSetQueueLength(dispatcher_t* dispatcher, size_t queue, size_t length)
+{
+    dispatcher->queues[queue].length = length;
+    dispatcher->queueUpdate(dispatcher->routerInfo, dispatcher, queue);
+}
+
+// Called at a job arrival to route and schedule the job
+void dispatcherScheduleJob(dispatcher_t* dispatcher, job_t* job)
+{
+    dispatcherDeliverJob(dispatcher, dispatcherRouteJob(dispatcher, job), job);
+}
+
+// Returns a uniformly distributed random number in [0, bound)
+size_t dispatcherRandom(dispatcher_t* dispatcher, size_t bound)
+{
+    // xorshift64* generator, scaled to the bound by a multiply-shift
+    uint64_t x = dispatcher->random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    dispatcher->random = x;
+    x *= 0x2545F4914F6CDD1DULL;
+    return (size_t)(((unsigned __int128)x * bound) >> 64);
+}
@@ -0,0 +1,152 @@
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "simulator.h"
+#include "scheduler.h"
+#include "job.h"
+
+typedef struct dispatcher dispatcher_t;
+
+// Routing policy options
+typedef struct {
+    size_t d; // number of queues sampled by power-of-d
+    const uint64_t* cutoffs; // SITA size cutoffs in ascending order (NULL for powers of two)
+    size_t numCutoffs; // number of SITA size cutoffs
+    uint64_t seed; // seed for randomized routing policies
+} router_options_t;
+
+// Creates and returns router specific info
+// dispatcher - dispatcher the router belongs to
+// options - routing policy options
+typedef void* (*router_info_create_fn)(dispatcher_t* dispatcher, const router_options_t* options);
+// Destroys router specific info
+typedef void (*router_info_destroy_fn)(void* routerInfo);
+// Called to pick the queue for a new job
+// routerInfo - router specific info from create function
+// dispatcher - used to query queue lengths and random numbers
+// job - job being routed
+// Returns the index of the queue the job is sent to
+typedef size_t (*route_job_fn)(void* routerInfo, dispatcher_t* dispatcher, job_t* job);
+// Called after the length of a queue changed
+// routerInfo - router specific info from create function
+// dispatcher - dispatcher the queue belongs to
+// queue - index of the queue that changed
+typedef void (*queue_update_fn)(void* routerInfo, dispatcher_t* dispatcher, size_t queue);
+
+// Function to call once a job completes at any of the queues
+// completionCallbackData - user specified data from when the dispatcher was created
+// job - job that is being completed
+// completionTime - simulated time of the completion
+typedef void (*dispatcherCompletionCallback_fn)(void* completionCallbackData, job_t* job, uint64_t completionTime);
+
+// Backend queue behind the dispatcher
+typedef struct {
+    dispatcher_t* dispatcher; // owning dispatcher
+    size_t index; // queue index
+    scheduler_t* scheduler; // queue scheduler
+    size_t length; // number of jobs at the queue
+    size_t completed; // completions not yet applied to length when updates are deferred
+} dispatcher_queue_t;
+
+// Queues sharing one simulator
+typedef struct {
+    size_t* updated; // queues with deferred completions
+    size_t numUpdated; // number of queues with deferred completions
+} dispatcher_partition_t;
+
+typedef struct dispatcher {
+    router_info_create_fn create; // router specific create function
+    router_info_destroy_fn destroy; // router specific destroy function
+    route_job_fn routeJob; // router specific route function
+    queue_update_fn queueUpdate; // router specific queue length update function
+    void* routerInfo; // router specific info
+    dispatcher_queue_t* queues; // backend queues
+    size_t numQueues; // number of backend queues
+    dispatcher_partition_t* partitions; // per simulator deferred updates (NULL when not deferring)
+    size_t numPartitions; // number of simulators the queues are spread over
+    bool usesQueueLengths; // routing decisions depend on queue lengths
+    uint64_t random; // random number generator state
+    dispatcherCompletionCallback_fn completionCallback; // function to call upon job completion
+    void* completionCallbackData; // data to pass to callback
+} dispatcher_t;
+
+// Initializes routing policy options to their defaults
+void routerOptionsInit(router_options_t* options);
+
+// Creates a dispatcher in front of numQueues queues sharing one simulator
+// routerName - name of routing policy
+// schedulerName - name of scheduler run by every queue, or NULL to only route jobs
+// numQueues - number of backend queues
+// sims - simulators, queue i uses sims[i % numSims]
+// numSims - number of simulators
+// options - routing policy options
+// completionCallback - function to call upon job completion
+// completionCallbackData - data to pass to completionCallback
+// Returns dispatcher on success or NULL otherwise
+dispatcher_t* dispatcherCreate(const char* routerName, const char* schedulerName, size_t numQueues, simulator_t** sims, size_t numSims, const router_options_t* options, dispatcherCompletionCallback_fn completionCallback, void* completionCallbackData);
+
+// Destroys a dispatcher and its queues
+void dispatcherDestroy(dispatcher_t* dispatcher);
+
+// Routes a job to a queue without scheduling it
+// Returns the index of the chosen queue
+size_t dispatcherRouteJob(dispatcher_t* dispatcher, job_t* job);
+
+// Schedules a routed job at its queue
+void dispatcherDeliverJob(dispatcher_t* dispatcher, size_t queue, job_t* job);
+
+// Sets the number of jobs at a queue that is simulated outside of the dispatcher
+void dispatcherSetQueueLength(dispatcher_t* dispatcher, size_t queue, size_t length);
+
+// Called at a job arrival to route and schedule the job
+void dispatcherScheduleJob(dispatcher_t* dispatcher, job_t* job);
+
+// Defers queue length updates caused by completions until dispatcherApplyUpdates
+// Queues in different simulators may then complete jobs from different threads
+// Returns true on success, false otherwise
+bool dispatcherDeferUpdates(dispatcher_t* dispatcher);
+
+// Applies deferred queue length updates
+// Must not run concurrently with the simulators of the queues
+void dispatcherApplyUpdates(dispatcher_t* dispatcher);
+
+// Returns the number of backend queues
+static inline size_t dispatcherNumQueues(dispatcher_t* dispatcher)
+{
+    return dispatcher->numQueues;
+}
+
+// Returns the number of jobs at a queue
+static inline size_t dispatcherQueueLength(dispatcher_t* dispatcher, size_t queue)
+{
+    return dispatcher->queues[queue].length;
+}
+
+// Returns a uniformly distributed random number in [0, bound)
+size_t dispatcherRandom(dispatcher_t* dispatcher, size_t bound);
+
+// Defines router specific functions
+#define DEFINE_ROUTER(routerName)                                       \
+    void* router ## routerName ## Create(dispatcher_t* dispatcher, const router_options_t* options); \
+    void router ## routerName ## Destroy(void* routerInfo);             \
+    size_t router ## routerName ## RouteJob(void* routerInfo, dispatcher_t* dispatcher, job_t* job); \
+    void router ## routerName ## QueueUpdate(void* routerInfo, dispatcher_t* dispatcher, size_t queue);
+
+// Initializes router specific functions
+#define INIT_ROUTER(d, routerName) do {                                 \
+        (d)->create = router ## routerName ## Create;                   \
+        (d)->destroy = router ## routerName ## Destroy;                 \
+        (d)->routeJob = router ## routerName ## RouteJob;               \
+        (d)->queueUpdate = router ## routerName ## QueueUpdate;         \
+    } while (0)
+
+DEFINE_ROUTER(Random)
+DEFINE_ROUTER(RR)
+DEFINE_ROUTER(JSQ)
+DEFINE_ROUTER(PowerOfD)
+DEFINE_ROUTER(SITA)
+
+#endif /* DISPATCHER_H */
@@ -0,0 +1,61 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include "trace.h"
+
+// Run a trace through a dispatcher whose queues are partitioned across threads
+// Partitions are synchronized with conservative time windows, so the output is the
+// same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by every queue
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineConservativeRun(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+// Run a trace through a dispatcher with optimistic (Time Warp) synchronization
+// Queues and the dispatcher speculatively process events and roll back when a
+// message arrives in their past, so the output is the same as with the sequential
+// engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by every queue
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineOptimisticRun(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+// Run a single queue trace by simulating its busy periods in parallel
+// The busy periods are found from arrival times and job sizes up front, so the
+// scheduler must be work conserving; the output is the same as with the sequential
+// engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineBusyPeriodRun(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+// Run a single FCFS queue from the closed form of its completion times
+// The trace is processed in blocks on parallel threads without simulating events;
+// the output is the same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue, must be FCFS
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineClosedFormRun(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+// Run a single LCFS or PLCFS queue on a stack without simulating events
+// The output is the same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue, must be LCFS or PLCFS
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineStackRun(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+// Run a single SJF, PSJF or SRPT queue on an indexed heap without simulating events
+// The output is the same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue, must be SJF, PSJF or SRPT
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineHeapRun(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+#endif /* ENGINE_H */
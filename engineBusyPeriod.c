@@ -0,0 +1,283 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "engine.h"
+#include "simulator.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "job.h"
+
+// Busy period decomposition
+//
+// A work-conserving single queue is empty exactly when all work that arrived so far
+// is done, so the end of the busy period a job arrives in follows from arrival times
+// and sizes alone: end = max(end, arrivalTime) + jobTime. A job arriving at or after
+// the end of the previous busy period starts a new one (a completion at the same time
+// as an arrival goes first). The queue is empty in between, which for every policy is
+// the same state as a freshly created scheduler, so the busy periods are independent.
+//
+// The trace is pre-scanned in memory for these boundaries, consecutive busy periods
+// are grouped into tasks of similar size, and worker threads (the calling thread
+// being one of them) pull tasks and simulate every busy period with its own simulator
+// and scheduler, reading the jobs through a stream over that part of the trace. Each
+// task buffers its output and the buffers are written in trace order at the end.
+// A busy period that does not end at the predicted time means the scheduler idled
+// with jobs in the queue, which is reported as an error.
+
+// Tasks per thread, so threads that got short busy periods can pick up more
+#define ENGINE_BUSY_TASKS_PER_THREAD 16
+
+// Busy period in the trace text
+typedef struct {
+    size_t offset; // offset of the first job in the trace text
+    uint64_t end; // time at which the last job of the busy period completes
+} engine_busy_period_t;
+
+// Consecutive busy periods simulated by one thread
+typedef struct {
+    size_t firstPeriod; // first busy period of the task
+    size_t numPeriods; // number of busy periods
+    char* output; // buffered output
+    size_t outputSize; // size of the buffered output
+} engine_busy_task_t;
+
+typedef struct {
+    char* text; // trace text
+    size_t length; // length of the trace text
+    engine_busy_period_t* periods; // busy periods in trace order
+    size_t numPeriods; // number of busy periods
+    engine_busy_task_t* tasks; // tasks in trace order
+    size_t numTasks; // number of tasks
+    size_t nextTask; // next task to hand out, advanced atomically
+    const char* schedulerName; // name of scheduler run for every busy period
+    bool failed; // set once any busy period failed
+} engine_busy_t;
+
+// Simulation of one busy period
+typedef struct {
+    trace_t trace; // trace over the busy period's jobs
+    uint64_t lastCompletionTime; // time of the latest completion
+} engine_busy_run_t;
+
+// Called when a job of a busy period completes
+// r - busy period run
+// job - job that is being completed
+static void engineBusyCompletionCallback(void* r, job_t* job)
+{
+    engine_busy_run_t* run = (engine_busy_run_t*)r;
+    run->lastCompletionTime = simulatorSimTime(run->trace.sim);
+    traceCompletionCallback(&run->trace, job);
+}
+
+// Finds the busy periods of the trace text
+// Returns true on success, false otherwise
+static bool engineBusyFindPeriods(engine_busy_t* engine)
+{
+    size_t capacity = 1024;
+    engine->periods = malloc(capacity * sizeof(engine_busy_period_t));
+    engine->numPeriods = 0;
+    if (engine->periods == NULL) {
+        return false;
+    }
+    const char* end = engine->text + engine->length;
+    const char* pos = engine->text;
+    uint64_t busyUntil = 0;
+    for (;;) {
+        uint64_t id;
+        uint64_t arrivalTime;
+        uint64_t jobTime;
+        const char* next = traceParseJob(pos, end, &id, &arrivalTime, &jobTime);
+        if (next == NULL) {
+            break;
+        }
+        if (engine->numPeriods == 0 || arrivalTime >= busyUntil) {
+            if (engine->numPeriods == capacity) {
+                capacity *= 2;
+                engine_busy_period_t* grown = realloc(engine->periods, capacity * sizeof(engine_busy_period_t));
+                if (grown == NULL) {
+                    return false;
+                }
+                engine->periods = grown;
+            }
+            engine->periods[engine->numPeriods++].offset = (size_t)(pos - engine->text);
+            busyUntil = arrivalTime;
+        }
+        busyUntil += jobTime;
+        engine->periods[engine->numPeriods - 1].end = busyUntil;
+        pos = next;
+    }
+    return true;
+}
+
+// Groups consecutive busy periods into tasks of similar length
+// Returns true on success, false otherwise
+static bool engineBusyCreateTasks(engine_busy_t* engine, size_t numThreads)
+{
+    size_t maxTasks = numThreads * ENGINE_BUSY_TASKS_PER_THREAD;
+    if (maxTasks > engine->numPeriods) {
+        maxTasks = engine->numPeriods;
+    }
+    engine->tasks = calloc(maxTasks ? maxTasks : 1, sizeof(engine_busy_task_t));
+    engine->numTasks = 0;
+    if (engine->tasks == NULL) {
+        return false;
+    }
+    size_t taskLength = maxTasks ? engine->length / maxTasks : 0;
+    engine_busy_task_t* task = NULL;
+    for (size_t i = 0; i < engine->numPeriods; i++) {
+        if (task == NULL || (engine->numTasks < maxTasks && engine->periods[i].offset - engine->periods[task->firstPeriod].offset >= taskLength)) {
+            task = &engine->tasks[engine->numTasks++];
+            task->firstPeriod = i;
+        }
+        task->numPeriods++;
+    }
+    return true;
+}
+
+// Simulates one busy period with a fresh simulator and scheduler
+// Returns true on success, false otherwise
+static bool engineBusyRunPeriod(engine_busy_t* engine, size_t period, FILE* outFile)
+{
+    size_t offset = engine->periods[period].offset;
+    size_t length = (period + 1 < engine->numPeriods ? engine->periods[period + 1].offset : engine->length) - offset;
+    engine_busy_run_t run;
+    run.lastCompletionTime = 0;
+    run.trace.outFile = outFile;
+    run.trace.dispatcher = NULL;
+    run.trace.batch = NULL;
+    run.trace.batchCapacity = 0;
+    run.trace.prefetch = NULL;
+    run.trace.follow = false;
+    run.trace.windowed = false;
+    run.trace.failed = false;
+    run.trace.traceFile = fmemopen(engine->text + offset, length, "r");
+    if (run.trace.traceFile == NULL) {
+        return false;
+    }
+    run.trace.sim = simulatorCreate();
+    if (run.trace.sim == NULL) {
+        fclose(run.trace.traceFile);
+        return false;
+    }
+    run.trace.scheduler = schedulerCreate(engine->schedulerName, run.trace.sim, engineBusyCompletionCallback, &run);
+    if (run.trace.scheduler == NULL) {
+        simulatorDestroy(run.trace.sim);
+        fclose(run.trace.traceFile);
+        return false;
+    }
+    traceScheduleNextArrival(&run.trace);
+    simulatorRun(run.trace.sim);
+    schedulerDestroy(run.trace.scheduler);
+    simulatorDestroy(run.trace.sim);
+    fclose(run.trace.traceFile);
+    free(run.trace.batch);
+    if (run.trace.failed) {
+        return false;
+    }
+    if (run.lastCompletionTime != engine->periods[period].end) {
+        printf("Scheduler %s is not work conserving: busy period ending at %" PRIu64 " ended at %" PRIu64 "\n",
+               engine->schedulerName, engine->periods[period].end, run.lastCompletionTime);
+        return false;
+    }
+    return true;
+}
+
+// Worker thread, pulls tasks until there are none left
+static void* engineBusyThread(void* e)
+{
+    engine_busy_t* engine = (engine_busy_t*)e;
+    for (;;) {
+        size_t index = __atomic_fetch_add(&engine->nextTask, 1, __ATOMIC_RELAXED);
+        if (index >= engine->numTasks || __atomic_load_n(&engine->failed, __ATOMIC_RELAXED)) {
+            return NULL;
+        }
+        engine_busy_task_t* task = &engine->tasks[index];
+        FILE* outFile = open_memstream(&task->output, &task->outputSize);
+        bool success = outFile != NULL;
+        for (size_t i = 0; success && i < task->numPeriods; i++) {
+            success = engineBusyRunPeriod(engine, task->firstPeriod + i, outFile);
+        }
+        if (outFile) {
+            fclose(outFile);
+        }
+        if (!success) {
+            __atomic_store_n(&engine->failed, true, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Run a single queue trace by simulating its busy periods in parallel
+// The busy periods are found from arrival times and job sizes up front, so the
+// scheduler must be work conserving; the output is the same as with the sequential
+// engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineBusyPeriodRun(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    if (options->numQueues > 1) {
+        printf("The busy period engine runs a single queue\n");
+        return false;
+    }
+    engine_busy_t engine;
+    engine.schedulerName = schedulerName;
+    engine.failed = false;
+    engine.nextTask = 0;
+    engine.periods = NULL;
+    engine.tasks = NULL;
+    engine.numTasks = 0;
+    size_t numThreads = options->numThreads ? options->numThreads : 1;
+    engine.text = traceReadAll(trace->traceFile, &engine.length);
+    bool success = engine.text != NULL && engineBusyFindPeriods(&engine) && engineBusyCreateTasks(&engine, numThreads);
+    if (success) {
+        // Reject an unknown scheduler once rather than in every task
+        simulator_t* sim = simulatorCreate();
+        scheduler_t* scheduler = sim ? schedulerCreate(schedulerName, sim, engineBusyCompletionCallback, NULL) : NULL;
+        success = scheduler != NULL;
+        if (scheduler) {
+            schedulerDestroy(scheduler);
+        }
+        if (sim) {
+            simulatorDestroy(sim);
+        }
+    }
+
+    if (success) {
+        if (numThreads > engine.numTasks) {
+            numThreads = engine.numTasks ? engine.numTasks : 1;
+        }
+        pthread_t* threads = malloc(numThreads * sizeof(pthread_t));
+        if (threads == NULL) {
+            success = false;
+            numThreads = 1;
+        }
+        size_t numStarted = 1;
+        for (; success && numStarted < numThreads; numStarted++) {
+            if (pthread_create(&threads[numStarted], NULL, engineBusyThread, &engine) != 0) {
+                break;
+            }
+        }
+        if (success) {
+            engineBusyThread(&engine);
+        }
+        for (size_t i = 1; i < numStarted; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        success = success && !engine.failed;
+    }
+
+    for (size_t i = 0; i < engine.numTasks; i++) {
+        if (success) {
+            fwrite(engine.tasks[i].output, 1, engine.tasks[i].outputSize, trace->outFile);
+        }
+        free(engine.tasks[i].output);
+    }
+    free(engine.tasks);
+    free(engine.periods);
+    free(engine.text);
+    return success;
+}
@@ -0,0 +1,249 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "engine.h"
+#include "trace.h"
+
+// Closed-form FCFS
+//
+// FCFS completion times follow the Lindley recursion C_i = max(C_{i-1}, A_i) + S_i,
+// so no events are needed. Every job is the map C -> max(C + s, b) with s = S_i and
+// b = A_i + S_i, and maps of this form compose in max-plus algebra:
+//   (s1, b1) then (s2, b2) = (s1 + s2, max(b1 + s2, b2))
+// Since b >= s for every job and stays so under composition, (0, 0) is the identity.
+//
+// The trace text is split into one block per thread at line boundaries. Each thread
+// parses its block into columns and composes the block's map, the calling thread
+// scans the block maps for the completion time before every block, and each thread
+// then computes its completions and formats its output. Within a block, groups of
+// four jobs are scanned in vector registers with two shifted compositions.
+
+// Four lanes of 64-bit values
+typedef uint64_t engine_lanes_t __attribute__((vector_size(32)));
+
+// Jobs of one block of the trace text
+typedef struct {
+    const char* start; // first byte of the block
+    const char* end; // end of the block
+    uint64_t* ids; // job ids
+    uint64_t* arrivals; // arrival times, overwritten with completion times
+    uint64_t* sizes; // job sizes
+    size_t numJobs; // number of jobs
+    uint64_t work; // total size of the block's jobs
+    uint64_t completion; // completion time of the last job if the queue is empty before the block
+    uint64_t completionIn; // completion time of the job before the block
+    bool valid; // whole block parsed with arrival times in order
+    char* output; // formatted output
+    size_t outputSize; // size of the formatted output
+    pthread_t thread; // thread running the block
+} engine_closed_form_block_t;
+
+// Sets every lane to the larger of the two values
+// Vectors are passed by reference, they are wider than the baseline vector registers
+static inline void engineLanesMax(engine_lanes_t* out, const engine_lanes_t* a, const engine_lanes_t* b)
+{
+    engine_lanes_t greater = (engine_lanes_t)(*a > *b);
+    *out = (*a & greater) | (*b & ~greater);
+}
+
+// Composes every lane's map with the map some lanes before it
+// back - lane to compose with, 4 selects the identity
+static inline void engineLanesCompose(engine_lanes_t* s, engine_lanes_t* b, const engine_lanes_t* back)
+{
+    const engine_lanes_t zero = {0, 0, 0, 0};
+    engine_lanes_t sBack = __builtin_shuffle(*s, zero, *back);
+    engine_lanes_t bBack = __builtin_shuffle(*b, zero, *back);
+    engine_lanes_t shifted = bBack + *s;
+    engineLanesMax(b, &shifted, b);
+    *s = sBack + *s;
+}
+
+// Parses a block into columns and composes its map
+static void* engineClosedFormParse(void* b)
+{
+    engine_closed_form_block_t* block = (engine_closed_form_block_t*)b;
+    size_t capacity = 1;
+    for (const char* pos = block->start; (pos = memchr(pos, '\n', (size_t)(block->end - pos))) != NULL; pos++) {
+        capacity++;
+    }
+    block->ids = malloc(capacity * sizeof(uint64_t));
+    block->arrivals = malloc(capacity * sizeof(uint64_t));
+    block->sizes = malloc(capacity * sizeof(uint64_t));
+    if (block->ids == NULL || block->arrivals == NULL || block->sizes == NULL) {
+        return NULL;
+    }
+    const char* pos = block->start;
+    uint64_t work = 0;
+    uint64_t completion = 0;
+    uint64_t lastArrival = 0;
+    block->valid = true;
+    while (block->numJobs < capacity) {
+        uint64_t id;
+        uint64_t arrivalTime;
+        uint64_t jobTime;
+        const char* next = traceParseJob(pos, block->end, &id, &arrivalTime, &jobTime);
+        if (next == NULL) {
+            break;
+        }
+        if (arrivalTime < lastArrival) {
+            block->valid = false;
+        }
+        lastArrival = arrivalTime;
+        block->ids[block->numJobs] = id;
+        block->arrivals[block->numJobs] = arrivalTime;
+        block->sizes[block->numJobs++] = jobTime;
+        work += jobTime;
+        completion = (completion + jobTime > arrivalTime + jobTime) ? completion + jobTime : arrivalTime + jobTime;
+        pos = next;
+    }
+    while (pos < block->end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')) {
+        pos++;
+    }
+    if (pos != block->end) {
+        block->valid = false;
+    }
+    block->work = work;
+    block->completion = completion;
+    return NULL;
+}
+
+// Computes a block's completion times and formats its output
+static void* engineClosedFormWrite(void* b)
+{
+    engine_closed_form_block_t* block = (engine_closed_form_block_t*)b;
+    const engine_lanes_t back1 = {4, 0, 1, 2};
+    const engine_lanes_t back2 = {4, 5, 0, 1};
+    uint64_t completion = block->completionIn;
+    size_t i = 0;
+    for (; i + 4 <= block->numJobs; i += 4) {
+        engine_lanes_t s;
+        engine_lanes_t a;
+        memcpy(&s, &block->sizes[i], sizeof(s));
+        memcpy(&a, &block->arrivals[i], sizeof(a));
+        engine_lanes_t b = a + s;
+        engineLanesCompose(&s, &b, &back1);
+        engineLanesCompose(&s, &b, &back2);
+        engine_lanes_t c = (engine_lanes_t){completion, completion, completion, completion} + s;
+        engineLanesMax(&c, &c, &b);
+        memcpy(&block->arrivals[i], &c, sizeof(c));
+        completion = c[3];
+    }
+    for (; i < block->numJobs; i++) {
+        uint64_t arrivalTime = block->arrivals[i];
+        completion = (completion > arrivalTime ? completion : arrivalTime) + block->sizes[i];
+        block->arrivals[i] = completion;
+    }
+    block->output = malloc(block->numJobs * TRACE_COMPLETION_MAX_LENGTH + 1);
+    if (block->output == NULL) {
+        return NULL;
+    }
+    char* out = block->output;
+    for (i = 0; i < block->numJobs; i++) {
+        out = traceFormatCompletion(out, block->ids[i], block->arrivals[i]);
+    }
+    block->outputSize = (size_t)(out - block->output);
+    return NULL;
+}
+
+// Runs a function for every block, block 0 on the calling thread
+static void engineClosedFormForEach(engine_closed_form_block_t* blocks, size_t numBlocks, void* (*fn)(void*))
+{
+    size_t numStarted = 1;
+    for (; numStarted < numBlocks; numStarted++) {
+        if (pthread_create(&blocks[numStarted].thread, NULL, fn, &blocks[numStarted]) != 0) {
+            break;
+        }
+    }
+    for (size_t i = numStarted; i < numBlocks; i++) {
+        fn(&blocks[i]);
+    }
+    fn(&blocks[0]);
+    for (size_t i = 1; i < numStarted; i++) {
+        pthread_join(blocks[i].thread, NULL);
+    }
+}
+
+// Run a single FCFS queue from the closed form of its completion times
+// The trace is processed in blocks on parallel threads without simulating events;
+// the output is the same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue, must be FCFS
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineClosedFormRun(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    if (strcmp(schedulerName, "FCFS") != 0 || options->numQueues > 1) {
+        printf("The closed-form engine runs a single FCFS queue\n");
+        return false;
+    }
+    size_t length;
+    char* text = traceReadAll(trace->traceFile, &length);
+    if (text == NULL) {
+        return false;
+    }
+    size_t numBlocks = options->numThreads ? options->numThreads : 1;
+    engine_closed_form_block_t* blocks = calloc(numBlocks, sizeof(engine_closed_form_block_t));
+    if (blocks == NULL) {
+        free(text);
+        return false;
+    }
+    // Blocks start after the first line break past an even split of the text
+    const char* end = text + length;
+    for (size_t i = 0; i < numBlocks; i++) {
+        const char* start = i ? blocks[i - 1].end : text;
+        const char* split = text + length / numBlocks * (i + 1);
+        if (split < start) {
+            split = start;
+        }
+        const char* lineEnd = split < end ? memchr(split, '\n', (size_t)(end - split)) : NULL;
+        blocks[i].start = start;
+        blocks[i].end = (i + 1 == numBlocks || lineEnd == NULL) ? end : lineEnd + 1;
+    }
+
+    engineClosedFormForEach(blocks, numBlocks, engineClosedFormParse);
+    bool success = true;
+    uint64_t completion = 0;
+    uint64_t lastArrival = 0;
+    for (size_t i = 0; i < numBlocks; i++) {
+        engine_closed_form_block_t* block = &blocks[i];
+        if (block->sizes == NULL || !block->valid) {
+            success = false;
+            break;
+        }
+        if (block->numJobs == 0) {
+            continue;
+        }
+        if (block->arrivals[0] < lastArrival) {
+            success = false;
+            break;
+        }
+        lastArrival = block->arrivals[block->numJobs - 1];
+        block->completionIn = completion;
+        completion = (completion + block->work > block->completion) ? completion + block->work : block->completion;
+    }
+    if (success) {
+        engineClosedFormForEach(blocks, numBlocks, engineClosedFormWrite);
+        for (size_t i = 0; i < numBlocks; i++) {
+            if (blocks[i].numJobs > 0 && blocks[i].output == NULL) {
+                success = false;
+            }
+        }
+        for (size_t i = 0; success && i < numBlocks; i++) {
+            fwrite(blocks[i].output, 1, blocks[i].outputSize, trace->outFile);
+        }
+    } else {
+        printf("The closed-form engine needs a well formed trace with arrival times in order\n");
+    }
+
+    for (size_t i = 0; i < numBlocks; i++) {
+        free(blocks[i].ids);
+        free(blocks[i].arrivals);
+        free(blocks[i].sizes);
+        free(blocks[i].output);
+    }
+    free(blocks);
+    free(text);
+    return success;
+}
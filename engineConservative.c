@@ -0,0 +1,213 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "engine.h"
+#include "dispatcher.h"
+#include "simulator.h"
+#include "trace.h"
+#include "job.h"
+
+// Conservative parallel discrete event simulation
+//
+// Queue i is simulated by partition i % P, each partition has its own simulator and
+// is run by its own thread (partition 0 by the calling thread). Queues only interact
+// through the dispatcher, so a partition can safely run up to the next time at which
+// the dispatcher may send it a job:
+// - When routing does not depend on queue lengths (RANDOM, RR, SITA), jobs are routed
+//   ahead of time in chunks and every partition replays its share of the chunk.
+// - Otherwise (JSQ, POD) the window ends at the next arrival. All partitions run up to
+//   it, then the dispatcher routes the arrivals at that time one at a time with the
+//   queue lengths the sequential engine would see.
+
+// Jobs routed per window when routing does not depend on queue lengths
+#define ENGINE_CHUNK_SIZE 4096
+
+typedef struct engine_conservative engine_conservative_t;
+
+// Job routed to a queue ahead of time
+typedef struct {
+    job_t* job; // routed job
+    size_t queue; // queue the job was routed to
+} engine_arrival_t;
+
+// Queues simulated by one thread
+typedef struct {
+    engine_conservative_t* engine; // owning engine
+    simulator_t* sim; // simulator shared by the partition's queues
+    engine_arrival_t* arrivals; // jobs routed to the partition in the current window
+    size_t numArrivals; // number of jobs routed in the current window
+    pthread_t thread; // thread running the partition
+} engine_partition_t;
+
+typedef struct engine_conservative {
+    dispatcher_t* dispatcher; // dispatcher in front of all queues
+    engine_partition_t* partitions; // partitions
+    size_t numPartitions; // number of partitions
+    uint64_t windowEnd; // partitions run all events up to this time
+    bool finished; // set to stop the partition threads
+    pthread_barrier_t windowStart; // partitions wait here for the next window
+    pthread_barrier_t windowDone; // partitions wait here once the window is simulated
+} engine_conservative_t;
+
+// Simulates one window of a partition
+static void engineConservativeRunPartition(engine_partition_t* partition)
+{
+    engine_conservative_t* engine = partition->engine;
+    for (size_t i = 0; i < partition->numArrivals; i++) {
+        engine_arrival_t* arrival = &partition->arrivals[i];
+        uint64_t arrivalTime = jobGetArrivalTime(arrival->job);
+        simulatorRunUntil(partition->sim, arrivalTime);
+        dispatcherDeliverJob(engine->dispatcher, arrival->queue, arrival->job);
+        // Completions at the arrival time go before the next arrival
+        simulatorRunUntil(partition->sim, arrivalTime);
+    }
+    partition->numArrivals = 0;
+    simulatorRunUntil(partition->sim, engine->windowEnd);
+}
+
+// Partition thread
+static void* engineConservativeThread(void* p)
+{
+    engine_partition_t* partition = (engine_partition_t*)p;
+    engine_conservative_t* engine = partition->engine;
+    for (;;) {
+        pthread_barrier_wait(&engine->windowStart);
+        if (engine->finished) {
+            break;
+        }
+        engineConservativeRunPartition(partition);
+        pthread_barrier_wait(&engine->windowDone);
+    }
+    return NULL;
+}
+
+// Simulates all partitions up to the end of the window
+static void engineConservativeRunWindow(engine_conservative_t* engine, uint64_t windowEnd)
+{
+    engine->windowEnd = windowEnd;
+    if (engine->numPartitions > 1) {
+        pthread_barrier_wait(&engine->windowStart);
+    }
+    engineConservativeRunPartition(&engine->partitions[0]);
+    if (engine->numPartitions > 1) {
+        pthread_barrier_wait(&engine->windowDone);
+    }
+    dispatcherApplyUpdates(engine->dispatcher);
+}
+
+// Routes jobs in chunks when routing does not depend on queue lengths
+static void engineConservativeRouteAhead(engine_conservative_t* engine, trace_t* trace)
+{
+    job_t* job = traceReadJob(trace);
+    while (job) {
+        uint64_t lastArrivalTime = 0;
+        for (size_t i = 0; i < ENGINE_CHUNK_SIZE && job; i++) {
+            size_t queue = dispatcherRouteJob(engine->dispatcher, job);
+            engine_partition_t* partition = &engine->partitions[queue % engine->numPartitions];
+            partition->arrivals[partition->numArrivals].job = job;
+            partition->arrivals[partition->numArrivals].queue = queue;
+            partition->numArrivals++;
+            lastArrivalTime = jobGetArrivalTime(job);
+            job = traceReadJob(trace);
+        }
+        // Later arrivals are not earlier than the last routed one
+        engineConservativeRunWindow(engine, lastArrivalTime);
+    }
+}
+
+// Routes jobs at their arrival time when routing depends on queue lengths
+static void engineConservativeRouteAtArrival(engine_conservative_t* engine, trace_t* trace)
+{
+    job_t* job = traceReadJob(trace);
+    while (job) {
+        uint64_t arrivalTime = jobGetArrivalTime(job);
+        engineConservativeRunWindow(engine, arrivalTime);
+        // Partitions are idle, so the dispatcher delivers the arrivals itself
+        while (job && jobGetArrivalTime(job) == arrivalTime) {
+            size_t queue = dispatcherRouteJob(engine->dispatcher, job);
+            engine_partition_t* partition = &engine->partitions[queue % engine->numPartitions];
+            dispatcherDeliverJob(engine->dispatcher, queue, job);
+            simulatorRunUntil(partition->sim, arrivalTime);
+            dispatcherApplyUpdates(engine->dispatcher);
+            job = traceReadJob(trace);
+        }
+    }
+}
+
+// Run a trace through a dispatcher whose queues are partitioned across threads
+// Partitions are synchronized with conservative time windows, so the output is the
+// same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by every queue
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineConservativeRun(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    engine_conservative_t engine;
+    engine.numPartitions = options->numThreads < options->numQueues ? options->numThreads : options->numQueues;
+    if (engine.numPartitions == 0) {
+        engine.numPartitions = 1;
+    }
+    engine.finished = false;
+    engine.partitions = calloc(engine.numPartitions, sizeof(engine_partition_t));
+    simulator_t** sims = calloc(engine.numPartitions, sizeof(simulator_t*));
+    bool success = engine.partitions != NULL && sims != NULL;
+    for (size_t i = 0; success && i < engine.numPartitions; i++) {
+        engine_partition_t* partition = &engine.partitions[i];
+        partition->engine = &engine;
+        partition->sim = sims[i] = simulatorCreate();
+        partition->arrivals = malloc(ENGINE_CHUNK_SIZE * sizeof(engine_arrival_t));
+        partition->numArrivals = 0;
+        success = partition->sim != NULL && partition->arrivals != NULL;
+    }
+    engine.dispatcher = NULL;
+    if (success) {
+        engine.dispatcher = dispatcherCreate(options->routerName, schedulerName, options->numQueues, sims, engine.numPartitions, &options->routerOptions, traceDispatcherCompletionCallback, trace);
+        success = engine.dispatcher != NULL && dispatcherDeferUpdates(engine.dispatcher);
+    }
+    size_t numThreads = 0;
+    if (success && engine.numPartitions > 1) {
+        pthread_barrier_init(&engine.windowStart, NULL, (unsigned)engine.numPartitions);
+        pthread_barrier_init(&engine.windowDone, NULL, (unsigned)engine.numPartitions);
+        for (numThreads = 1; numThreads < engine.numPartitions; numThreads++) {
+            if (pthread_create(&engine.partitions[numThreads].thread, NULL, engineConservativeThread, &engine.partitions[numThreads]) != 0) {
+                // Threads that did start are waiting at the window start barrier
+                printf("Failed to start partition thread\n");
+                exit(-1);
+            }
+        }
+    }
+
+    if (success) {
+        if (engine.dispatcher->usesQueueLengths) {
+            engineConservativeRouteAtArrival(&engine, trace);
+        } else {
+            engineConservativeRouteAhead(&engine, trace);
+        }
+        // Drain the remaining completions
+        engineConservativeRunWindow(&engine, UINT64_MAX);
+    }
+
+    if (numThreads > 1) {
+        engine.finished = true;
+        pthread_barrier_wait(&engine.windowStart);
+        for (size_t i = 1; i < numThreads; i++) {
+            pthread_join(engine.partitions[i].thread, NULL);
+        }
+        pthread_barrier_destroy(&engine.windowStart);
+        pthread_barrier_destroy(&engine.windowDone);
+    }
+    if (engine.dispatcher) {
+        dispatcherDestroy(engine.dispatcher);
+    }
+    for (size_t i = 0; engine.partitions && i < engine.numPartitions; i++) {
+        if (engine.partitions[i].sim) {
+            simulatorDestroy(engine.partitions[i].sim);
+        }
+        free(engine.partitions[i].arrivals);
+    }
+    free(engine.partitions);
+    free(sims);
+    return success;
+}
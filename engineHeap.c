@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "engine.h"
+#include "jobHeap.h"
+#include "trace.h"
+
+// Heap-based SJF, PSJF and SRPT
+//
+// The size-based policies serve the job with the smallest (size or remaining time, id)
+// and differ only in when an arrival takes the server: never under SJF, when it is
+// smaller than the job in service under PSJF, and when it is smaller than the work
+// the job in service has left under SRPT. A single queue needs no events: the next
+// completion is always that of the job in service, and it is due before an arrival
+// at the same time. All jobs of the queue, the one in service included, are in an
+// indexed heap keyed the way the policy sorts its queue; the job in service is known
+// by its handle, so completing it is a removal by handle, and an SRPT preemption
+// re-keys it with the work it has left. Every step is O(log n) with no allocation
+// per job.
+
+// Policy of the queue, in the order of the names in engineHeapRun
+typedef enum {
+    ENGINE_HEAP_SJF, // shortest job first
+    ENGINE_HEAP_PSJF, // preemptive shortest job first
+    ENGINE_HEAP_SRPT, // shortest remaining processing time
+} engine_heap_policy_t;
+
+typedef struct {
+    job_heap_t* heap; // jobs in the queue
+    engine_heap_policy_t policy; // policy of the queue
+    size_t running; // handle of the job in service, JOB_HEAP_NONE when idle
+    uint64_t start; // time the job in service last started or resumed
+    trace_writer_t writer; // buffered output
+} engine_heap_t;
+
+// Completes the jobs due at or before a time
+static inline void engineHeapAdvance(engine_heap_t* queue, uint64_t currentTime)
+{
+    while (queue->running != JOB_HEAP_NONE) {
+        uint64_t completion = queue->start + jobHeapRemaining(queue->heap, queue->running);
+        if (completion > currentTime) {
+            return;
+        }
+        traceWriterComplete(&queue->writer, jobHeapId(queue->heap, queue->running), completion);
+        jobHeapRemove(queue->heap, queue->running);
+        queue->running = jobHeapTop(queue->heap);
+        queue->start = completion;
+    }
+}
+
+// Schedules a job arriving at the current time
+// Returns true on success, false otherwise
+static inline bool engineHeapArrive(engine_heap_t* queue, uint64_t id, uint64_t arrivalTime, uint64_t jobTime)
+{
+    size_t handle = jobHeapPush(queue->heap, jobTime, id, jobTime);
+    if (handle == JOB_HEAP_NONE) {
+        return false;
+    }
+    if (queue->running == JOB_HEAP_NONE) {
+        queue->running = handle;
+        queue->start = arrivalTime;
+        return true;
+    }
+    // The job in service has run since it last started, without completing
+    uint64_t remaining = jobHeapRemaining(queue->heap, queue->running) - (arrivalTime - queue->start);
+    bool preempt;
+    if (queue->policy == ENGINE_HEAP_PSJF) {
+        preempt = jobTime < jobHeapKey(queue->heap, queue->running);
+    } else {
+        preempt = queue->policy == ENGINE_HEAP_SRPT && jobTime < remaining;
+    }
+    if (preempt) {
+        jobHeapSetRemaining(queue->heap, queue->running, remaining);
+        if (queue->policy == ENGINE_HEAP_SRPT) {
+            jobHeapUpdate(queue->heap, queue->running, remaining);
+        }
+        queue->running = handle;
+        queue->start = arrivalTime;
+    }
+    return true;
+}
+
+// Run a single SJF, PSJF or SRPT queue on an indexed heap without simulating events
+// The output is the same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue, must be SJF, PSJF or SRPT
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineHeapRun(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    static const char* const policyNames[] = {"SJF", "PSJF", "SRPT"};
+    engine_heap_t queue = {0};
+    size_t policy = 0;
+    while (policy < sizeof(policyNames) / sizeof(policyNames[0]) && strcmp(schedulerName, policyNames[policy]) != 0) {
+        policy++;
+    }
+    if (policy == sizeof(policyNames) / sizeof(policyNames[0]) || options->numQueues > 1) {
+        printf("The heap engine runs a single SJF, PSJF or SRPT queue\n");
+        return false;
+    }
+    size_t length;
+    char* text = traceReadAll(trace->traceFile, &length);
+    if (text == NULL) {
+        return false;
+    }
+    queue.policy = (engine_heap_policy_t)policy;
+    queue.running = JOB_HEAP_NONE;
+    queue.heap = jobHeapCreate();
+    bool success = traceWriterInit(&queue.writer, trace->outFile) && queue.heap != NULL;
+
+    const char* pos = text;
+    const char* end = text + length;
+    uint64_t lastArrival = 0;
+    bool valid = true;
+    while (success) {
+        uint64_t id;
+        uint64_t arrivalTime;
+        uint64_t jobTime;
+        const char* next = traceParseJob(pos, end, &id, &arrivalTime, &jobTime);
+        if (next == NULL) {
+            break;
+        }
+        if (arrivalTime < lastArrival) {
+            valid = false;
+            break;
+        }
+        lastArrival = arrivalTime;
+        engineHeapAdvance(&queue, arrivalTime);
+        success = engineHeapArrive(&queue, id, arrivalTime, jobTime);
+        pos = next;
+    }
+    while (valid && pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')) {
+        pos++;
+    }
+    if (success && (!valid || pos != end)) {
+        printf("The heap engine needs a well formed trace with arrival times in order\n");
+        success = false;
+    }
+    if (success) {
+        engineHeapAdvance(&queue, UINT64_MAX);
+        traceWriterFlush(&queue.writer);
+    }
+
+    if (queue.heap != NULL) {
+        jobHeapDestroy(queue.heap);
+    }
+    traceWriterDestroy(&queue.writer);
+    free(text);
+    return success;
+}
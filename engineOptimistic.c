@@ -0,0 +1,923 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "engine.h"
+#include "dispatcher.h"
+#include "scheduler.h"
+#include "simulator.h"
+#include "trace.h"
+#include "job.h"
+
+// Optimistic (Time Warp) parallel discrete event simulation
+//
+// The dispatcher and every queue are logical processes (LPs). Queue i is run by
+// executor i % E, the dispatcher by executor 0, where executor 0 is the calling
+// thread. LPs process their events speculatively and exchange messages:
+// - the dispatcher sends arrivals to queues
+// - queues send completions to the dispatcher, which keeps the queue lengths for
+//   routing (only when routing depends on queue lengths)
+// A message in the past of its receiver (a straggler) rolls the receiver back, and
+// rolled back messages are cancelled with anti-messages.
+//
+// Every event has a key that orders it like the sequential engine does:
+// - arrival j (the j-th job in the trace) at time a has key (a, 2j + 1)
+// - a completion at time t has key (t, 2s), where s is 0 if it was scheduled before
+//   time t, so it goes before all arrivals at t, and otherwise j + 1 for the arrival
+//   j whose processing (directly or through a chain of completions) scheduled it
+//
+// State saving: a queue's state is fully determined by its input arrivals, and a
+// queue without jobs is equivalent to a fresh scheduler. Queues checkpoint the points
+// at which they become idle and roll back by recreating their scheduler at the latest
+// idle checkpoint and replaying the logged arrivals. The dispatcher's routing state
+// is the queue lengths plus the random number generator, which it restores by
+// reverse computation.
+//
+// GVT: executors synchronize every round. Once all executors are quiescent, the GVT
+// is the smallest key of any unprocessed event or message. Completions with a
+// smaller key are final and written out, and logs before the GVT are fossil
+// collected. Executors only process events up to GVT + window per round, which
+// bounds how far speculation runs ahead.
+
+typedef struct tw_engine tw_engine_t;
+typedef struct tw_executor tw_executor_t;
+
+// Event key
+typedef struct {
+    uint64_t time; // simulated time
+    uint64_t seq; // order of events at the same time
+} tw_key_t;
+
+static const tw_key_t TW_KEY_MIN = {0, 0};
+static const tw_key_t TW_KEY_MAX = {UINT64_MAX, UINT64_MAX};
+
+typedef enum {
+    TW_ARRIVAL, // job arrival at a queue
+    TW_ARRIVAL_ANTI, // cancels an arrival at a queue
+    TW_COMPLETION, // job completion reported to the dispatcher
+    TW_COMPLETION_ANTI // cancels a completion reported to the dispatcher
+} tw_message_type_t;
+
+// Message between LPs
+typedef struct {
+    tw_message_type_t type; // message type
+    tw_key_t key; // key of the event
+    size_t queue; // queue receiving the arrival or reporting the completion
+    uint64_t id; // job id
+    uint64_t arrivalTime; // job arrival time (arrivals only)
+    uint64_t jobTime; // job time (arrivals only)
+} tw_message_t;
+
+// Growable message array
+typedef struct {
+    tw_message_t* messages; // messages
+    size_t count; // number of messages
+    size_t capacity; // allocated messages
+} tw_messages_t;
+
+// Arrival received by a queue
+typedef struct {
+    tw_key_t key; // arrival key
+    job_t* job; // job, reused when the arrival is replayed
+} tw_input_t;
+
+// Completion produced by a queue, not final yet
+typedef struct {
+    tw_key_t key; // completion key
+    uint64_t id; // job id
+} tw_output_t;
+
+// Point at which a queue had no jobs
+typedef struct {
+    tw_key_t key; // key of the event that emptied the queue
+    size_t input; // inputs processed at that point
+} tw_checkpoint_t;
+
+// Queue LP
+typedef struct {
+    tw_engine_t* engine; // owning engine
+    size_t index; // queue index
+    simulator_t* sim; // queue simulator
+    scheduler_t* scheduler; // queue scheduler
+    tw_input_t* inputs; // arrivals in key order
+    size_t numInputs; // number of arrivals
+    size_t inputCapacity; // allocated arrivals
+    size_t next; // next unprocessed arrival
+    tw_output_t* outputs; // completions in key order
+    size_t numOutputs; // number of completions
+    size_t outputCapacity; // allocated completions
+    tw_output_t* stale; // rolled back completions in key order, not cancelled yet
+    size_t numStale; // number of rolled back completions
+    size_t staleCapacity; // allocated rolled back completions
+    tw_checkpoint_t* checkpoints; // idle checkpoints in key order
+    size_t numCheckpoints; // number of idle checkpoints
+    size_t checkpointCapacity; // allocated idle checkpoints
+    tw_key_t lvt; // key of the last processed event
+    uint64_t currentSeq; // s of the event being processed
+    uint64_t pendingSeq; // s of the scheduled completion
+    size_t numJobs; // jobs at the queue
+    bool replaying; // replaying events that were already processed
+} tw_queue_t;
+
+// Event processed by the dispatcher
+typedef struct {
+    tw_key_t key; // event key
+    bool arrival; // arrival or completion
+    size_t queue; // queue the job was routed to or completed at
+    uint64_t id; // job id
+    uint64_t arrivalTime; // job arrival time (arrivals only)
+    uint64_t jobTime; // job time (arrivals only)
+    uint64_t random; // random number generator state before routing (arrivals only)
+} tw_processed_t;
+
+// Dispatcher LP
+typedef struct {
+    dispatcher_t* dispatcher; // routing policy and queue lengths
+    trace_t* trace; // trace the arrivals are read from
+    job_t* nextJob; // next job in the trace
+    uint64_t nextIndex; // index of the next job in the trace
+    tw_processed_t* processed; // processed events in key order
+    size_t numProcessed; // number of processed events
+    size_t processedCapacity; // allocated processed events
+    tw_processed_t* redo; // rolled back arrivals, the next one last, still at their queues
+    size_t numRedo; // number of rolled back arrivals
+    size_t redoCapacity; // allocated rolled back arrivals
+    tw_messages_t pending; // unprocessed completions as a min-heap
+} tw_dispatcher_t;
+
+// Thread running a set of LPs
+typedef struct tw_executor {
+    tw_engine_t* engine; // owning engine
+    size_t index; // executor index
+    pthread_t thread; // thread running the executor
+    pthread_mutex_t lock; // protects the inbox
+    tw_messages_t inbox; // messages sent to the executor's LPs
+    tw_messages_t received; // messages taken from the inbox
+    tw_queue_t* queues; // queue LPs run by the executor
+    size_t numQueues; // number of queue LPs
+    tw_key_t localMin; // smallest unprocessed key at the GVT computation
+    bool idle; // inbox was empty at the GVT computation
+} tw_executor_t;
+
+typedef struct tw_engine {
+    const char* schedulerName; // name of scheduler run by every queue
+    trace_t* trace; // trace
+    tw_executor_t* executors; // executors
+    size_t numExecutors; // number of executors
+    tw_dispatcher_t dispatcher; // dispatcher LP
+    uint64_t window; // how far past the GVT events are processed
+    uint64_t horizon; // events at or after this time wait for the next round
+    tw_key_t gvt; // global virtual time
+    bool quiescent; // no messages were in flight at the last GVT computation
+    pthread_barrier_t barrier; // round synchronization
+} tw_engine_t;
+
+// Compares two keys
+static inline int twKeyCompare(tw_key_t a, tw_key_t b)
+{
+    if (a.time != b.time) {
+        return a.time < b.time ? -1 : 1;
+    }
+    if (a.seq != b.seq) {
+        return a.seq < b.seq ? -1 : 1;
+    }
+    return 0;
+}
+
+// Returns the smaller of two keys
+static inline tw_key_t twKeyMin(tw_key_t a, tw_key_t b)
+{
+    return twKeyCompare(a, b) <= 0 ? a : b;
+}
+
+// Key of arrival index at the given time
+static inline tw_key_t twArrivalKey(uint64_t time, uint64_t index)
+{
+    tw_key_t key = {time, 2 * index + 1};
+    return key;
+}
+
+// Key of a completion at the given time
+static inline tw_key_t twCompletionKey(uint64_t time, uint64_t seq)
+{
+    tw_key_t key = {time, 2 * seq};
+    return key;
+}
+
+// Grows an array to hold at least count + 1 elements
+// Exits on allocation failure since a partially updated LP cannot be recovered
+static void* twReserve(void* array, size_t* capacity, size_t count, size_t size)
+{
+    if (count < *capacity) {
+        return array;
+    }
+    size_t newCapacity = *capacity ? 2 * *capacity : 16;
+    void* newArray = realloc(array, newCapacity * size);
+    if (newArray == NULL) {
+        printf("Out of memory in optimistic engine\n");
+        exit(-1);
+    }
+    *capacity = newCapacity;
+    return newArray;
+}
+
+// Appends a message
+static void twMessagesPush(tw_messages_t* messages, const tw_message_t* message)
+{
+    messages->messages = twReserve(messages->messages, &messages->capacity, messages->count, sizeof(tw_message_t));
+    messages->messages[messages->count++] = *message;
+}
+
+// Sends a message to the executor running the destination LP
+static void twSend(tw_engine_t* engine, const tw_message_t* message)
+{
+    bool toDispatcher = message->type == TW_COMPLETION || message->type == TW_COMPLETION_ANTI;
+    tw_executor_t* executor = &engine->executors[toDispatcher ? 0 : message->queue % engine->numExecutors];
+    pthread_mutex_lock(&executor->lock);
+    twMessagesPush(&executor->inbox, message);
+    pthread_mutex_unlock(&executor->lock);
+}
+
+// Restores the heap property upwards from position i
+static void twHeapSiftUp(tw_messages_t* heap, size_t i)
+{
+    while (i > 0 && twKeyCompare(heap->messages[i].key, heap->messages[(i - 1) / 2].key) < 0) {
+        tw_message_t tmp = heap->messages[i];
+        heap->messages[i] = heap->messages[(i - 1) / 2];
+        heap->messages[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+// Restores the heap property downwards from position i
+static void twHeapSiftDown(tw_messages_t* heap, size_t i)
+{
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < heap->count && twKeyCompare(heap->messages[left].key, heap->messages[smallest].key) < 0) {
+            smallest = left;
+        }
+        if (right < heap->count && twKeyCompare(heap->messages[right].key, heap->messages[smallest].key) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        tw_message_t tmp = heap->messages[i];
+        heap->messages[i] = heap->messages[smallest];
+        heap->messages[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Removes the message at position i of the heap
+static void twHeapRemove(tw_messages_t* heap, size_t i)
+{
+    heap->messages[i] = heap->messages[--heap->count];
+    if (i < heap->count) {
+        twHeapSiftUp(heap, i);
+        twHeapSiftDown(heap, i);
+    }
+}
+
+// Queue LPs
+
+// Called when a job completes at a queue
+static void twQueueCompletionCallback(void* q, job_t* job)
+{
+    tw_queue_t* queue = (tw_queue_t*)q;
+    queue->numJobs--;
+    if (queue->replaying) {
+        return;
+    }
+    tw_key_t key = twCompletionKey(simulatorSimTime(queue->sim), queue->currentSeq);
+    queue->outputs = twReserve(queue->outputs, &queue->outputCapacity, queue->numOutputs, sizeof(tw_output_t));
+    queue->outputs[queue->numOutputs].key = key;
+    queue->outputs[queue->numOutputs].id = jobGetId(job);
+    queue->numOutputs++;
+    // A rolled back completion that is produced again was already sent
+    for (size_t i = 0; i < queue->numStale && twKeyCompare(queue->stale[i].key, key) == 0; i++) {
+        if (queue->stale[i].id == jobGetId(job)) {
+            memmove(&queue->stale[i], &queue->stale[i + 1], (queue->numStale - i - 1) * sizeof(tw_output_t));
+            queue->numStale--;
+            return;
+        }
+    }
+    if (queue->engine->dispatcher.dispatcher->usesQueueLengths) {
+        tw_message_t message = {TW_COMPLETION, key, queue->index, jobGetId(job), 0, 0};
+        twSend(queue->engine, &message);
+    }
+}
+
+// Creates a fresh simulator and scheduler for a queue at the given time
+// Returns true on success, false otherwise
+static bool twQueueReset(tw_queue_t* queue, uint64_t time)
+{
+    if (queue->scheduler) {
+        schedulerDestroy(queue->scheduler);
+        queue->scheduler = NULL;
+    }
+    if (queue->sim) {
+        simulatorDestroy(queue->sim);
+    }
+    queue->sim = simulatorCreate();
+    if (queue->sim == NULL) {
+        return false;
+    }
+    simulatorRunUntil(queue->sim, time);
+    queue->scheduler = schedulerCreate(queue->engine->schedulerName, queue->sim, twQueueCompletionCallback, queue);
+    queue->numJobs = 0;
+    queue->pendingSeq = 0;
+    return queue->scheduler != NULL;
+}
+
+// Gets the key of the next unprocessed event of a queue
+// Returns false if there is none
+static bool twQueueNextKey(tw_queue_t* queue, tw_key_t* key, bool* completion)
+{
+    uint64_t completionTime;
+    bool hasCompletion = schedulerNextCompletionTime(queue->scheduler, &completionTime);
+    bool hasArrival = queue->next < queue->numInputs;
+    // Completions go before arrivals at the same time
+    if (hasCompletion && (!hasArrival || completionTime <= queue->inputs[queue->next].key.time)) {
+        *key = twCompletionKey(completionTime, queue->pendingSeq);
+        *completion = true;
+        return true;
+    }
+    if (hasArrival) {
+        *key = queue->inputs[queue->next].key;
+        *completion = false;
+        return true;
+    }
+    return false;
+}
+
+// Cancels rolled back completions before the given key that were not produced again
+// Returns true if any anti-message was sent
+static bool twQueueCancelStale(tw_queue_t* queue, tw_key_t key)
+{
+    size_t cancelled = 0;
+    while (cancelled < queue->numStale && twKeyCompare(queue->stale[cancelled].key, key) < 0) {
+        cancelled++;
+    }
+    if (cancelled == 0) {
+        return false;
+    }
+    bool send = queue->engine->dispatcher.dispatcher->usesQueueLengths;
+    for (size_t i = 0; send && i < cancelled; i++) {
+        tw_message_t message = {TW_COMPLETION_ANTI, queue->stale[i].key, queue->index, queue->stale[i].id, 0, 0};
+        twSend(queue->engine, &message);
+    }
+    memmove(queue->stale, &queue->stale[cancelled], (queue->numStale - cancelled) * sizeof(tw_output_t));
+    queue->numStale -= cancelled;
+    return send;
+}
+
+// Processes the next event of a queue
+static void twQueueStep(tw_queue_t* queue, tw_key_t key, bool completion)
+{
+    if (!queue->replaying) {
+        twQueueCancelStale(queue, key);
+    }
+    if (completion) {
+        queue->currentSeq = queue->pendingSeq;
+        simulatorStep(queue->sim);
+    } else {
+        tw_input_t* input = &queue->inputs[queue->next++];
+        simulatorRunUntil(queue->sim, key.time);
+        queue->currentSeq = (input->key.seq - 1) / 2 + 1;
+        queue->numJobs++;
+        schedulerScheduleJob(queue->scheduler, input->job);
+    }
+    queue->lvt = key;
+    // A completion scheduled at the current time follows the current event
+    uint64_t completionTime;
+    bool hasCompletion = schedulerNextCompletionTime(queue->scheduler, &completionTime);
+    queue->pendingSeq = hasCompletion && completionTime == key.time ? queue->currentSeq : 0;
+    if (queue->numJobs == 0 && !queue->replaying) {
+        queue->checkpoints = twReserve(queue->checkpoints, &queue->checkpointCapacity, queue->numCheckpoints, sizeof(tw_checkpoint_t));
+        queue->checkpoints[queue->numCheckpoints].key = key;
+        queue->checkpoints[queue->numCheckpoints].input = queue->next;
+        queue->numCheckpoints++;
+    }
+}
+
+// Rolls a queue back to just before the given arrival key
+static void twQueueRollback(tw_queue_t* queue, tw_key_t key)
+{
+    // Completions sent after the key are only cancelled if they are not produced again
+    size_t kept = queue->numOutputs;
+    while (kept > 0 && twKeyCompare(queue->outputs[kept - 1].key, key) > 0) {
+        kept--;
+    }
+    size_t rolledBack = queue->numOutputs - kept;
+    if (rolledBack > 0) {
+        for (size_t i = 0; i < rolledBack; i++) {
+            queue->stale = twReserve(queue->stale, &queue->staleCapacity, queue->numStale + i, sizeof(tw_output_t));
+        }
+        memmove(&queue->stale[rolledBack], queue->stale, queue->numStale * sizeof(tw_output_t));
+        memcpy(queue->stale, &queue->outputs[kept], rolledBack * sizeof(tw_output_t));
+        queue->numStale += rolledBack;
+        queue->numOutputs = kept;
+    }
+    // Restore the latest idle checkpoint before the key
+    while (twKeyCompare(queue->checkpoints[queue->numCheckpoints - 1].key, key) > 0) {
+        queue->numCheckpoints--;
+    }
+    tw_checkpoint_t* checkpoint = &queue->checkpoints[queue->numCheckpoints - 1];
+    for (size_t i = checkpoint->input; i < queue->next; i++) {
+        jobSetRemainingTime(queue->inputs[i].job, jobGetJobTime(queue->inputs[i].job));
+    }
+    if (!twQueueReset(queue, checkpoint->key.time)) {
+        printf("Failed to restore queue %zu\n", queue->index);
+        exit(-1);
+    }
+    queue->next = checkpoint->input;
+    queue->lvt = checkpoint->key;
+    // Replay up to the key, the completions were already sent
+    queue->replaying = true;
+    tw_key_t nextKey;
+    bool completion;
+    while (twQueueNextKey(queue, &nextKey, &completion) && twKeyCompare(nextKey, key) < 0) {
+        twQueueStep(queue, nextKey, completion);
+    }
+    queue->replaying = false;
+}
+
+// Finds the position of the arrival with the given key or where it would be inserted
+static size_t twQueueFindInput(tw_queue_t* queue, tw_key_t key)
+{
+    size_t low = 0;
+    size_t high = queue->numInputs;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (twKeyCompare(queue->inputs[mid].key, key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Handles an arrival or arrival anti-message at a queue
+static void twQueueReceive(tw_queue_t* queue, const tw_message_t* message)
+{
+    size_t position = twQueueFindInput(queue, message->key);
+    if (twKeyCompare(message->key, queue->lvt) <= 0) {
+        // Straggler or cancellation of a processed arrival
+        twQueueRollback(queue, message->key);
+    }
+    if (message->type == TW_ARRIVAL) {
+        job_t* job = jobCreate(message->arrivalTime, message->jobTime, message->id);
+        queue->inputs = twReserve(queue->inputs, &queue->inputCapacity, queue->numInputs, sizeof(tw_input_t));
+        memmove(&queue->inputs[position + 1], &queue->inputs[position], (queue->numInputs - position) * sizeof(tw_input_t));
+        queue->inputs[position].key = message->key;
+        queue->inputs[position].job = job;
+        queue->numInputs++;
+    } else {
+        jobDestroy(queue->inputs[position].job);
+        memmove(&queue->inputs[position], &queue->inputs[position + 1], (queue->numInputs - position - 1) * sizeof(tw_input_t));
+        queue->numInputs--;
+    }
+}
+
+// Writes final completions and discards state before the GVT
+static void twQueueFossilCollect(tw_queue_t* queue, tw_key_t gvt)
+{
+    size_t committed = 0;
+    while (committed < queue->numOutputs && twKeyCompare(queue->outputs[committed].key, gvt) < 0) {
+        tw_output_t* output = &queue->outputs[committed++];
+        fprintf(queue->engine->trace->outFile, "%" PRIu64 ",%" PRIu64 "\n", output->id, output->key.time);
+    }
+    if (committed > 0) {
+        memmove(queue->outputs, &queue->outputs[committed], (queue->numOutputs - committed) * sizeof(tw_output_t));
+        queue->numOutputs -= committed;
+    }
+    // Keep the latest checkpoint before the GVT, arrivals before it are final
+    size_t keep = 0;
+    while (keep + 1 < queue->numCheckpoints && twKeyCompare(queue->checkpoints[keep + 1].key, gvt) < 0) {
+        keep++;
+    }
+    if (keep == 0) {
+        return;
+    }
+    size_t inputs = queue->checkpoints[keep].input;
+    for (size_t i = 0; i < inputs; i++) {
+        jobDestroy(queue->inputs[i].job);
+    }
+    if (inputs > 0) {
+        memmove(queue->inputs, &queue->inputs[inputs], (queue->numInputs - inputs) * sizeof(tw_input_t));
+        queue->numInputs -= inputs;
+        queue->next -= inputs;
+    }
+    memmove(queue->checkpoints, &queue->checkpoints[keep], (queue->numCheckpoints - keep) * sizeof(tw_checkpoint_t));
+    queue->numCheckpoints -= keep;
+    for (size_t i = 0; i < queue->numCheckpoints; i++) {
+        queue->checkpoints[i].input -= inputs;
+    }
+}
+
+// Dispatcher LP
+
+// Gets the key of the next unprocessed dispatcher event
+// Returns false if there is none
+static bool twDispatcherNextKey(tw_dispatcher_t* dispatcher, tw_key_t* key, bool* arrival)
+{
+    bool found = false;
+    if (dispatcher->numRedo > 0) {
+        tw_processed_t* redo = &dispatcher->redo[dispatcher->numRedo - 1];
+        *key = redo->key;
+        found = true;
+    } else if (dispatcher->nextJob) {
+        *key = twArrivalKey(jobGetArrivalTime(dispatcher->nextJob), dispatcher->nextIndex);
+        found = true;
+    }
+    *arrival = found;
+    if (dispatcher->pending.count > 0 && (!found || twKeyCompare(dispatcher->pending.messages[0].key, *key) < 0)) {
+        *key = dispatcher->pending.messages[0].key;
+        *arrival = false;
+        found = true;
+    }
+    return found;
+}
+
+// Appends a processed dispatcher event
+static void twDispatcherPushProcessed(tw_dispatcher_t* dispatcher, const tw_processed_t* processed)
+{
+    dispatcher->processed = twReserve(dispatcher->processed, &dispatcher->processedCapacity, dispatcher->numProcessed, sizeof(tw_processed_t));
+    dispatcher->processed[dispatcher->numProcessed++] = *processed;
+}
+
+// Processes the next dispatcher event
+static void twDispatcherStep(tw_engine_t* engine, bool arrival)
+{
+    tw_dispatcher_t* dispatcher = &engine->dispatcher;
+    dispatcher_t* router = dispatcher->dispatcher;
+    tw_processed_t processed;
+    if (arrival) {
+        bool redo = dispatcher->numRedo > 0;
+        if (redo) {
+            processed = dispatcher->redo[--dispatcher->numRedo];
+        } else {
+            job_t* job = dispatcher->nextJob;
+            processed.key = twArrivalKey(jobGetArrivalTime(job), dispatcher->nextIndex++);
+            processed.arrival = true;
+            processed.id = jobGetId(job);
+            processed.arrivalTime = jobGetArrivalTime(job);
+            processed.jobTime = jobGetJobTime(job);
+            jobDestroy(job);
+            dispatcher->nextJob = traceReadJob(dispatcher->trace);
+        }
+        processed.random = router->random;
+        job_t* job = jobCreate(processed.arrivalTime, processed.jobTime, processed.id);
+        size_t queue = dispatcherRouteJob(router, job);
+        jobDestroy(job);
+        dispatcherSetQueueLength(router, queue, dispatcherQueueLength(router, queue) + 1);
+        // A rolled back arrival is only cancelled if it is routed to another queue
+        if (!redo || queue != processed.queue) {
+            if (redo) {
+                tw_message_t anti = {TW_ARRIVAL_ANTI, processed.key, processed.queue, processed.id, 0, 0};
+                twSend(engine, &anti);
+            }
+            processed.queue = queue;
+            tw_message_t message = {TW_ARRIVAL, processed.key, processed.queue, processed.id, processed.arrivalTime, processed.jobTime};
+            twSend(engine, &message);
+        }
+    } else {
+        tw_message_t* message = &dispatcher->pending.messages[0];
+        processed.key = message->key;
+        processed.arrival = false;
+        processed.queue = message->queue;
+        processed.id = message->id;
+        twHeapRemove(&dispatcher->pending, 0);
+        dispatcherSetQueueLength(router, processed.queue, dispatcherQueueLength(router, processed.queue) - 1);
+    }
+    twDispatcherPushProcessed(dispatcher, &processed);
+}
+
+// Undoes the last processed dispatcher event
+static void twDispatcherUndo(tw_engine_t* engine)
+{
+    tw_dispatcher_t* dispatcher = &engine->dispatcher;
+    dispatcher_t* router = dispatcher->dispatcher;
+    tw_processed_t* processed = &dispatcher->processed[--dispatcher->numProcessed];
+    if (processed->arrival) {
+        dispatcherSetQueueLength(router, processed->queue, dispatcherQueueLength(router, processed->queue) - 1);
+        router->random = processed->random;
+        dispatcher->redo = twReserve(dispatcher->redo, &dispatcher->redoCapacity, dispatcher->numRedo, sizeof(tw_processed_t));
+        dispatcher->redo[dispatcher->numRedo++] = *processed;
+    } else {
+        dispatcherSetQueueLength(router, processed->queue, dispatcherQueueLength(router, processed->queue) + 1);
+        tw_message_t message = {TW_COMPLETION, processed->key, processed->queue, processed->id, 0, 0};
+        twMessagesPush(&dispatcher->pending, &message);
+        twHeapSiftUp(&dispatcher->pending, dispatcher->pending.count - 1);
+    }
+}
+
+// Rolls the dispatcher back to just after the given key
+static void twDispatcherRollback(tw_engine_t* engine, tw_key_t key)
+{
+    tw_dispatcher_t* dispatcher = &engine->dispatcher;
+    while (dispatcher->numProcessed > 0 && twKeyCompare(dispatcher->processed[dispatcher->numProcessed - 1].key, key) > 0) {
+        twDispatcherUndo(engine);
+    }
+}
+
+// Handles a completion or completion anti-message at the dispatcher
+static void twDispatcherReceive(tw_engine_t* engine, const tw_message_t* message)
+{
+    tw_dispatcher_t* dispatcher = &engine->dispatcher;
+    // Straggler or cancellation of a processed completion
+    twDispatcherRollback(engine, message->key);
+    if (message->type == TW_COMPLETION) {
+        twMessagesPush(&dispatcher->pending, message);
+        twHeapSiftUp(&dispatcher->pending, dispatcher->pending.count - 1);
+        return;
+    }
+    // Completions with equal keys may have been processed after the cancelled one
+    for (size_t i = dispatcher->numProcessed; i > 0 && twKeyCompare(dispatcher->processed[i - 1].key, message->key) == 0; i--) {
+        tw_processed_t* processed = &dispatcher->processed[i - 1];
+        if (!processed->arrival && processed->queue == message->queue && processed->id == message->id) {
+            dispatcherSetQueueLength(dispatcher->dispatcher, processed->queue, dispatcherQueueLength(dispatcher->dispatcher, processed->queue) + 1);
+            memmove(processed, processed + 1, (dispatcher->numProcessed - i) * sizeof(tw_processed_t));
+            dispatcher->numProcessed--;
+            return;
+        }
+    }
+    for (size_t i = 0; i < dispatcher->pending.count; i++) {
+        tw_message_t* pending = &dispatcher->pending.messages[i];
+        if (pending->queue == message->queue && pending->id == message->id && twKeyCompare(pending->key, message->key) == 0) {
+            twHeapRemove(&dispatcher->pending, i);
+            return;
+        }
+    }
+}
+
+// Discards dispatcher state before the GVT
+static void twDispatcherFossilCollect(tw_dispatcher_t* dispatcher, tw_key_t gvt)
+{
+    size_t committed = 0;
+    while (committed < dispatcher->numProcessed && twKeyCompare(dispatcher->processed[committed].key, gvt) < 0) {
+        committed++;
+    }
+    if (committed > 0) {
+        memmove(dispatcher->processed, &dispatcher->processed[committed], (dispatcher->numProcessed - committed) * sizeof(tw_processed_t));
+        dispatcher->numProcessed -= committed;
+    }
+}
+
+// Executors
+
+// Handles the messages in an executor's inbox
+// Returns true if there were any
+static bool twExecutorReceive(tw_executor_t* executor)
+{
+    tw_engine_t* engine = executor->engine;
+    pthread_mutex_lock(&executor->lock);
+    tw_messages_t received = executor->inbox;
+    executor->inbox = executor->received;
+    pthread_mutex_unlock(&executor->lock);
+    for (size_t i = 0; i < received.count; i++) {
+        tw_message_t* message = &received.messages[i];
+        if (message->type == TW_COMPLETION || message->type == TW_COMPLETION_ANTI) {
+            twDispatcherReceive(engine, message);
+        } else {
+            twQueueReceive(&executor->queues[message->queue / engine->numExecutors], message);
+        }
+    }
+    bool any = received.count > 0;
+    received.count = 0;
+    executor->received = received;
+    return any;
+}
+
+// Processes events and messages of an executor until it has nothing left before the horizon
+// Events of the executor's LPs are processed in key order, so LPs of the same
+// executor never roll each other back
+static void twExecutorRun(tw_executor_t* executor)
+{
+    tw_engine_t* engine = executor->engine;
+    for (;;) {
+        bool received = twExecutorReceive(executor);
+        tw_key_t min = TW_KEY_MAX;
+        tw_queue_t* next = NULL;
+        tw_key_t key;
+        bool flag;
+        bool nextFlag = false;
+        if (executor->index == 0 && twDispatcherNextKey(&engine->dispatcher, &key, &flag)) {
+            min = key;
+            nextFlag = flag;
+        }
+        for (size_t i = 0; i < executor->numQueues; i++) {
+            if (twQueueNextKey(&executor->queues[i], &key, &flag) && twKeyCompare(key, min) < 0) {
+                min = key;
+                next = &executor->queues[i];
+                nextFlag = flag;
+            }
+        }
+        if (twKeyCompare(min, TW_KEY_MAX) == 0 || min.time >= engine->horizon) {
+            // Rolled back completions before a queue's next event will not be produced again
+            for (size_t i = 0; i < executor->numQueues; i++) {
+                tw_queue_t* queue = &executor->queues[i];
+                if (!twQueueNextKey(queue, &key, &flag)) {
+                    key = TW_KEY_MAX;
+                }
+                received |= twQueueCancelStale(queue, key);
+            }
+            if (!received) {
+                return;
+            }
+            continue;
+        }
+        if (next) {
+            twQueueStep(next, min, nextFlag);
+        } else {
+            twDispatcherStep(engine, nextFlag);
+        }
+    }
+}
+
+// Gets the smallest key of any unprocessed event or message of an executor
+// Must be called while all executors are quiescent
+static tw_key_t twExecutorLocalMin(tw_executor_t* executor)
+{
+    tw_key_t min = TW_KEY_MAX;
+    tw_key_t key;
+    bool flag;
+    if (executor->index == 0 && twDispatcherNextKey(&executor->engine->dispatcher, &key, &flag)) {
+        min = twKeyMin(min, key);
+    }
+    for (size_t i = 0; i < executor->numQueues; i++) {
+        if (twQueueNextKey(&executor->queues[i], &key, &flag)) {
+            min = twKeyMin(min, key);
+        }
+    }
+    for (size_t i = 0; i < executor->inbox.count; i++) {
+        min = twKeyMin(min, executor->inbox.messages[i].key);
+    }
+    return min;
+}
+
+// Runs rounds of speculative processing, GVT computation and fossil collection
+// A round ends once no executor has messages left, the GVT is then the smallest
+// key of any unprocessed event
+static void twExecutorLoop(tw_executor_t* executor)
+{
+    tw_engine_t* engine = executor->engine;
+    bool parallel = engine->numExecutors > 1;
+    for (;;) {
+        twExecutorRun(executor);
+        if (parallel) {
+            pthread_barrier_wait(&engine->barrier);
+        }
+        executor->localMin = twExecutorLocalMin(executor);
+        executor->idle = executor->inbox.count == 0;
+        if (parallel) {
+            pthread_barrier_wait(&engine->barrier);
+        }
+        if (executor->index == 0) {
+            engine->quiescent = true;
+            engine->gvt = TW_KEY_MAX;
+            for (size_t i = 0; i < engine->numExecutors; i++) {
+                engine->quiescent &= engine->executors[i].idle;
+                engine->gvt = twKeyMin(engine->gvt, engine->executors[i].localMin);
+            }
+            if (engine->quiescent) {
+                uint64_t horizon = engine->gvt.time + engine->window;
+                engine->horizon = horizon < engine->gvt.time ? UINT64_MAX : horizon;
+            }
+        }
+        if (parallel) {
+            pthread_barrier_wait(&engine->barrier);
+        }
+        tw_key_t gvt = engine->gvt;
+        for (size_t i = 0; i < executor->numQueues; i++) {
+            twQueueFossilCollect(&executor->queues[i], gvt);
+        }
+        if (executor->index == 0) {
+            twDispatcherFossilCollect(&engine->dispatcher, gvt);
+        }
+        if (twKeyCompare(gvt, TW_KEY_MAX) == 0) {
+            break;
+        }
+    }
+}
+
+// Executor thread
+static void* twExecutorThread(void* e)
+{
+    twExecutorLoop((tw_executor_t*)e);
+    return NULL;
+}
+
+// Destroys an executor's queues and buffers
+static void twExecutorDestroy(tw_executor_t* executor)
+{
+    for (size_t i = 0; executor->queues && i < executor->numQueues; i++) {
+        tw_queue_t* queue = &executor->queues[i];
+        if (queue->scheduler) {
+            schedulerDestroy(queue->scheduler);
+        }
+        if (queue->sim) {
+            simulatorDestroy(queue->sim);
+        }
+        for (size_t j = 0; j < queue->numInputs; j++) {
+            jobDestroy(queue->inputs[j].job);
+        }
+        free(queue->inputs);
+        free(queue->outputs);
+        free(queue->stale);
+        free(queue->checkpoints);
+    }
+    free(executor->queues);
+    free(executor->inbox.messages);
+    free(executor->received.messages);
+    pthread_mutex_destroy(&executor->lock);
+}
+
+// Run a trace through a dispatcher with optimistic (Time Warp) synchronization
+// Queues and the dispatcher speculatively process events and roll back when a
+// message arrives in their past, so the output is the same as with the sequential
+// engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by every queue
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineOptimisticRun(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    tw_engine_t engine;
+    memset(&engine, 0, sizeof(engine));
+    engine.schedulerName = schedulerName;
+    engine.trace = trace;
+    engine.window = options->window ? options->window : 1;
+    engine.horizon = engine.window;
+    engine.numExecutors = options->numThreads < options->numQueues ? options->numThreads : options->numQueues;
+    if (engine.numExecutors == 0) {
+        engine.numExecutors = 1;
+    }
+    engine.dispatcher.trace = trace;
+    engine.dispatcher.dispatcher = dispatcherCreate(options->routerName, NULL, options->numQueues, NULL, 0, &options->routerOptions, NULL, NULL);
+    engine.executors = calloc(engine.numExecutors, sizeof(tw_executor_t));
+    bool success = engine.dispatcher.dispatcher != NULL && engine.executors != NULL;
+    size_t numExecutors = 0;
+    for (; success && numExecutors < engine.numExecutors; numExecutors++) {
+        tw_executor_t* executor = &engine.executors[numExecutors];
+        executor->engine = &engine;
+        executor->index = numExecutors;
+        pthread_mutex_init(&executor->lock, NULL);
+        executor->numQueues = (options->numQueues + engine.numExecutors - 1 - numExecutors) / engine.numExecutors;
+        executor->queues = calloc(executor->numQueues, sizeof(tw_queue_t));
+        success = executor->queues != NULL;
+        for (size_t i = 0; success && i < executor->numQueues; i++) {
+            tw_queue_t* queue = &executor->queues[i];
+            queue->engine = &engine;
+            queue->index = i * engine.numExecutors + numExecutors;
+            queue->lvt = TW_KEY_MIN;
+            queue->checkpoints = twReserve(NULL, &queue->checkpointCapacity, 0, sizeof(tw_checkpoint_t));
+            queue->checkpoints[0].key = TW_KEY_MIN;
+            queue->checkpoints[0].input = 0;
+            queue->numCheckpoints = 1;
+            success = twQueueReset(queue, 0);
+        }
+    }
+
+    if (success) {
+        engine.dispatcher.nextJob = traceReadJob(trace);
+        if (engine.numExecutors > 1) {
+            pthread_barrier_init(&engine.barrier, NULL, (unsigned)engine.numExecutors);
+            for (size_t i = 1; i < engine.numExecutors; i++) {
+                if (pthread_create(&engine.executors[i].thread, NULL, twExecutorThread, &engine.executors[i]) != 0) {
+                    printf("Failed to start executor thread\n");
+                    exit(-1);
+                }
+            }
+        }
+        twExecutorLoop(&engine.executors[0]);
+        if (engine.numExecutors > 1) {
+            for (size_t i = 1; i < engine.numExecutors; i++) {
+                pthread_join(engine.executors[i].thread, NULL);
+            }
+            pthread_barrier_destroy(&engine.barrier);
+        }
+    }
+
+    for (size_t i = 0; i < numExecutors; i++) {
+        twExecutorDestroy(&engine.executors[i]);
+    }
+    free(engine.executors);
+    if (engine.dispatcher.nextJob) {
+        jobDestroy(engine.dispatcher.nextJob);
+    }
+    free(engine.dispatcher.processed);
+    free(engine.dispatcher.redo);
+    free(engine.dispatcher.pending.messages);
+    if (engine.dispatcher.dispatcher) {
+        dispatcherDestroy(engine.dispatcher.dispatcher);
+    }
+    return success;
+}
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "engine.h"
+#include "trace.h"
+
+// Stack-based LCFS and PLCFS
+//
+// Both policies only ever touch the most recent arrival, so a single queue is a stack
+// and needs no events: the next completion is always that of the job in service, and
+// it is due before an arrival at the same time. Each arrival first completes the jobs
+// due by its arrival time and then pushes the new job. LCFS keeps the job in service
+// off the stack and pops the next one when it completes; PLCFS serves the top of the
+// stack, so preempting it on an arrival is charging it the time it ran since it last
+// resumed. Jobs are (id, remaining work) pairs in one growable array, so every step
+// is a constant number of array operations with no allocation per job.
+
+// Initial number of stack entries
+#define ENGINE_STACK_INITIAL_CAPACITY 1024
+
+// Waiting or preempted job
+typedef struct {
+    uint64_t id; // job id
+    uint64_t remaining; // remaining work, the job size until the job is preempted
+} engine_stack_entry_t;
+
+typedef struct {
+    engine_stack_entry_t* entries; // jobs, most recent arrival last
+    size_t count; // number of jobs on the stack
+    size_t capacity; // allocated entries
+    bool preemptive; // serve the top of the stack (PLCFS) instead of a job taken off it (LCFS)
+    bool busy; // LCFS has a job in service
+    uint64_t runningId; // id of the LCFS job in service
+    uint64_t completion; // completion time of the LCFS job in service
+    uint64_t start; // time the top PLCFS job last started or resumed
+    trace_writer_t writer; // buffered output
+} engine_stack_t;
+
+// Pushes a job on the stack, doubling the stack when it is full
+// Returns true on success, false otherwise
+static inline bool engineStackPush(engine_stack_t* stack, uint64_t id, uint64_t remaining)
+{
+    if (stack->count == stack->capacity) {
+        size_t capacity = 2 * stack->capacity;
+        engine_stack_entry_t* entries = realloc(stack->entries, capacity * sizeof(engine_stack_entry_t));
+        if (entries == NULL) {
+            return false;
+        }
+        stack->entries = entries;
+        stack->capacity = capacity;
+    }
+    stack->entries[stack->count].id = id;
+    stack->entries[stack->count++].remaining = remaining;
+    return true;
+}
+
+// Completes the jobs due at or before a time
+// For PLCFS, the job in service after that has run until the time
+static inline void engineStackAdvance(engine_stack_t* stack, uint64_t currentTime)
+{
+    if (stack->preemptive) {
+        while (stack->count > 0) {
+            engine_stack_entry_t* top = &stack->entries[stack->count - 1];
+            if (stack->start + top->remaining > currentTime) {
+                top->remaining -= currentTime - stack->start;
+                stack->start = currentTime;
+                return;
+            }
+            stack->start += top->remaining;
+            traceWriterComplete(&stack->writer, top->id, stack->start);
+            stack->count--;
+        }
+        return;
+    }
+    while (stack->busy && stack->completion <= currentTime) {
+        traceWriterComplete(&stack->writer, stack->runningId, stack->completion);
+        if (stack->count > 0) {
+            engine_stack_entry_t* top = &stack->entries[--stack->count];
+            stack->runningId = top->id;
+            stack->completion += top->remaining;
+        } else {
+            stack->busy = false;
+        }
+    }
+}
+
+// Schedules a job arriving at the current time
+// Returns true on success, false otherwise
+static inline bool engineStackArrive(engine_stack_t* stack, uint64_t id, uint64_t arrivalTime, uint64_t jobTime)
+{
+    if (stack->preemptive) {
+        // The job in service was charged up to the arrival by engineStackAdvance
+        stack->start = arrivalTime;
+        return engineStackPush(stack, id, jobTime);
+    }
+    if (!stack->busy) {
+        stack->busy = true;
+        stack->runningId = id;
+        stack->completion = arrivalTime + jobTime;
+        return true;
+    }
+    return engineStackPush(stack, id, jobTime);
+}
+
+// Run a single LCFS or PLCFS queue on a stack without simulating events
+// The output is the same as with the sequential engine
+// trace - trace with open trace and output files
+// schedulerName - name of scheduler run by the queue, must be LCFS or PLCFS
+// options - trace run options
+// Returns true on success, false otherwise
+bool engineStackRun(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    bool preemptive = strcmp(schedulerName, "PLCFS") == 0;
+    if ((!preemptive && strcmp(schedulerName, "LCFS") != 0) || options->numQueues > 1) {
+        printf("The stack engine runs a single LCFS or PLCFS queue\n");
+        return false;
+    }
+    size_t length;
+    char* text = traceReadAll(trace->traceFile, &length);
+    if (text == NULL) {
+        return false;
+    }
+    engine_stack_t stack = {0};
+    stack.preemptive = preemptive;
+    stack.capacity = ENGINE_STACK_INITIAL_CAPACITY;
+    stack.entries = malloc(stack.capacity * sizeof(engine_stack_entry_t));
+    bool success = traceWriterInit(&stack.writer, trace->outFile) && stack.entries != NULL;
+
+    const char* pos = text;
+    const char* end = text + length;
+    uint64_t lastArrival = 0;
+    bool valid = true;
+    while (success) {
+        uint64_t id;
+        uint64_t arrivalTime;
+        uint64_t jobTime;
+        const char* next = traceParseJob(pos, end, &id, &arrivalTime, &jobTime);
+        if (next == NULL) {
+            break;
+        }
+        if (arrivalTime < lastArrival) {
+            valid = false;
+            break;
+        }
+        lastArrival = arrivalTime;
+        engineStackAdvance(&stack, arrivalTime);
+        success = engineStackArrive(&stack, id, arrivalTime, jobTime);
+        pos = next;
+    }
+    while (valid && pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')) {
+        pos++;
+    }
+    if (success && (!valid || pos != end)) {
+        printf("The stack engine needs a well formed trace with arrival times in order\n");
+        success = false;
+    }
+    if (success) {
+        engineStackAdvance(&stack, UINT64_MAX);
+        traceWriterFlush(&stack.writer);
+    }
+
+    free(stack.entries);
+    traceWriterDestroy(&stack.writer);
+    free(text);
+    return success;
+}
@@ -12,14 +12,48 @@ sandbox_dir = "sandbox"
 # Location of original files and the files to copy
 original_dir = "."
 files_to_copy = ["linked_list_test.c",
+                 "dispatcher.c",
+                 "dispatcher.h",
+                 "engine.h",
+                 "engineConservative.c",
+                 "engineOptimistic.c",
+                 "engineBusyPeriod.c",
+                 "engineClosedForm.c",
+                 "engineStack.c",
+                 "engineHeap.c",
+                 "job.c",
+                 "libsimulator.c",
+                 "libsimulator.h",
+                 "jobIndex.c",
+                 "jobIndex.h",
+                 "jobSpill.c",
+                 "jobSpill.h",
+                 "jobHeap.c",
+                 "jobHeap.h",
+                 "perfCounters.c",
+                 "perfCounters.h",
                  "main.c",
                  "Makefile",
                  "scheduler.c",
                  "scheduler.h",
+                 "schedulerMLFQ.c",
+                 "schedulerSpill.c",
+                 "schedulerRR.c",
+                 "routerJSQ.c",
+                 "routerPowerOfD.c",
+                 "routerRandom.c",
+                 "routerRR.c",
+                 "routerSITA.c",
                  "simulator.c",
                  "simulator.h",
                  "trace.c",
-                 "trace.h"]
+                 "trace.h",
+                 "traceCache.c",
+                 "traceCache.h",
+                 "traceGzip.c",
+                 "traceGzip.h",
+                 "traceIndex.c",
+                 "traceIndex.h"]
 
 # Handin files
 handin_files = ["linked_list.c",
@@ -56,6 +90,10 @@ add_test_cases("test_list_create")
 add_test_cases("test_list_insert")
 add_test_cases("test_list_find")
 add_test_cases("test_list_remove")
+add_test_cases("test_job_index")
+add_test_cases("test_job_index_list")
+add_test_cases("test_job_spill")
+add_test_cases("test_job_heap")
 
 def add_test_cases_trace(test_name, policy, input_file):
     output_file = f"{input_file}.out"
@@ -89,6 +127,7 @@ part1_point_breakdown = [
 part1 = ["FCFS", "LCFS", "SJF", "PLCFS"]
 part2_point_breakdown = []
 part2 = ["PSJF", "SRPT", "PS", "FB"]
+framework = ["RR", "MLFQ"]
 
 for f in sorted(os.listdir(os.path.join(original_dir, traces_dir))):
     filename = os.fsdecode(f)
@@ -100,7 +139,7 @@ for f in sorted(os.listdir(os.path.join(original_dir, traces_dir))):
         elif policy in part2:
             part2_point_breakdown.append((1, [filename]))
             part2_point_breakdown.append((1, [f"valgrind_{filename}"]))
-        else:
+        elif policy not in framework:
             print(f"Skipping trace {filename} since filename is not in appropriate format")
 
 def print_success(test):
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "job.h"
+
+#ifdef JOB_STORE
+
+job_store_t jobStore = {.numHandles = 0, .freeHandle = 0, .numFree = 0, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Allocates a handle
+// Returns the handle or UINT32_MAX if the store is full
+uint32_t jobStoreAllocate(void)
+{
+    uint32_t handle = UINT32_MAX;
+    pthread_mutex_lock(&jobStore.lock);
+    if (jobStore.numFree > 0) {
+        // Free handles are linked through their id column
+        handle = jobStore.freeHandle;
+        jobStore.freeHandle = (uint32_t)jobStore.chunks[handle >> JOB_STORE_CHUNK_BITS]->id[handle & (JOB_STORE_CHUNK_SIZE - 1)];
+        jobStore.numFree--;
+    } else if (jobStore.numHandles < UINT32_MAX) {
+        uint32_t chunk = jobStore.numHandles >> JOB_STORE_CHUNK_BITS;
+        if (jobStore.chunks[chunk] == NULL) {
+            jobStore.chunks[chunk] = malloc(sizeof(job_store_chunk_t));
+        }
+        if (jobStore.chunks[chunk] != NULL) {
+            handle = jobStore.numHandles++;
+        }
+    }
+    pthread_mutex_unlock(&jobStore.lock);
+    return handle;
+}
+
+// Frees a handle
+void jobStoreFree(uint32_t handle)
+{
+    pthread_mutex_lock(&jobStore.lock);
+    jobStore.chunks[handle >> JOB_STORE_CHUNK_BITS]->id[handle & (JOB_STORE_CHUNK_SIZE - 1)] = jobStore.freeHandle;
+    jobStore.freeHandle = handle;
+    jobStore.numFree++;
+    pthread_mutex_unlock(&jobStore.lock);
+}
+
+#endif /* JOB_STORE */
@@ -4,6 +4,122 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef JOB_STORE
+
+#include <pthread.h>
+
+// Job store (build with make JOB_STORE=1)
+// Job fields live in separate columns so code that scans many jobs only touches
+// the column it needs. A job is a 32-bit handle into the columns, carried in the
+// job_t pointer as handle + 1 so NULL still means no job. Columns are allocated in
+// chunks that never move, so handles stay valid while the store grows, and freed
+// handles are reused most recently freed first to keep live jobs dense.
+
+#define JOB_STORE_CHUNK_BITS 16
+#define JOB_STORE_CHUNK_SIZE ((uint32_t)1 << JOB_STORE_CHUNK_BITS)
+#define JOB_STORE_MAX_CHUNKS ((uint32_t)1 << (32 - JOB_STORE_CHUNK_BITS))
+
+// Job information
+// DO NOT DIRECTLY USE THE STORE
+// USE THE FUNCTIONS BELOW INSTEAD
+typedef struct job job_t;
+
+// Columns of JOB_STORE_CHUNK_SIZE jobs
+typedef struct {
+    uint64_t arrivalTime[JOB_STORE_CHUNK_SIZE]; // arrival times
+    uint64_t jobTime[JOB_STORE_CHUNK_SIZE]; // job times
+    uint64_t remainingTime[JOB_STORE_CHUNK_SIZE]; // remaining job times
+    uint64_t id[JOB_STORE_CHUNK_SIZE]; // job ids, the next free handle for free handles
+} job_store_chunk_t;
+
+typedef struct {
+    job_store_chunk_t* chunks[JOB_STORE_MAX_CHUNKS]; // column chunks
+    uint32_t numHandles; // handles handed out so far
+    uint32_t freeHandle; // most recently freed handle
+    size_t numFree; // number of free handles
+    pthread_mutex_t lock; // protects allocation, jobs may be created and destroyed on different threads
+} job_store_t;
+
+extern job_store_t jobStore;
+
+// Allocates a handle
+// Returns the handle or UINT32_MAX if the store is full
+uint32_t jobStoreAllocate(void);
+
+// Frees a handle
+void jobStoreFree(uint32_t handle);
+
+// Get the handle of a job
+static inline uint32_t jobGetHandle(job_t* job)
+{
+    return (uint32_t)((uintptr_t)job - 1);
+}
+// Get the column chunk of a job
+static inline job_store_chunk_t* jobGetChunk(job_t* job)
+{
+    return jobStore.chunks[jobGetHandle(job) >> JOB_STORE_CHUNK_BITS];
+}
+// Get the index of a job within its chunk
+static inline uint32_t jobGetIndex(job_t* job)
+{
+    return jobGetHandle(job) & (JOB_STORE_CHUNK_SIZE - 1);
+}
+// Create a new job
+static inline job_t* jobCreate(uint64_t arrivalTime, uint64_t jobTime, uint64_t id)
+{
+    uint32_t handle = jobStoreAllocate();
+    if (handle == UINT32_MAX) {
+        return NULL;
+    }
+    job_t* job = (job_t*)((uintptr_t)handle + 1);
+    job_store_chunk_t* chunk = jobGetChunk(job);
+    uint32_t index = jobGetIndex(job);
+    chunk->arrivalTime[index] = arrivalTime;
+    chunk->jobTime[index] = jobTime;
+    chunk->remainingTime[index] = jobTime;
+    chunk->id[index] = id;
+    return job;
+}
+// Destroy a job
+static inline void jobDestroy(job_t* job)
+{
+    jobStoreFree(jobGetHandle(job));
+}
+// Get arrival time
+static inline uint64_t jobGetArrivalTime(job_t* job)
+{
+    return jobGetChunk(job)->arrivalTime[jobGetIndex(job)];
+}
+// Get job time
+static inline uint64_t jobGetJobTime(job_t* job)
+{
+    return jobGetChunk(job)->jobTime[jobGetIndex(job)];
+}
+// Get remaining time
+static inline uint64_t jobGetRemainingTime(job_t* job)
+{
+    return jobGetChunk(job)->remainingTime[jobGetIndex(job)];
+}
+// Set remaining time
+static inline void jobSetRemainingTime(job_t* job, uint64_t remainingTime)
+{
+    jobGetChunk(job)->remainingTime[jobGetIndex(job)] = remainingTime;
+}
+// Get completed time
+static inline uint64_t jobGetCompletedTime(job_t* job)
+{
+    job_store_chunk_t* chunk = jobGetChunk(job);
+    uint32_t index = jobGetIndex(job);
+    return chunk->jobTime[index] - chunk->remainingTime[index];
+}
+// Get job id
+static inline uint64_t jobGetId(job_t* job)
+{
+    return jobGetChunk(job)->id[jobGetIndex(job)];
+}
+
+#else
+
 // Job information
 // DO NOT DIRECTLY USE THESE FIELDS
 // USE THE FUNCTIONS BELOW INSTEAD
@@ -62,4 +178,6 @@ static inline uint64_t jobGetId(job_t* job)
     return job->id;
 }
 
+#endif /* JOB_STORE */
+
 #endif /* JOB_H */
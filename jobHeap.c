@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "jobHeap.h"
+
+// Slots of a new heap
+#define JOB_HEAP_INITIAL_CAPACITY 64
+
+// Returns true if a node goes before another
+static inline bool jobHeapLess(const job_heap_node_t* a, const job_heap_node_t* b)
+{
+    return a->key < b->key || (a->key == b->key && a->id < b->id);
+}
+
+// Stores a node in a slot and records the slot in the position map
+static inline void jobHeapPlace(job_heap_t* heap, size_t position, const job_heap_node_t* node)
+{
+    heap->nodes[position] = *node;
+    heap->jobs[node->handle].position = position;
+}
+
+// Moves a node up from a slot until its parent goes before it
+static void jobHeapSiftUp(job_heap_t* heap, size_t position, job_heap_node_t node)
+{
+    while (position > 0) {
+        size_t parent = (position - 1) / JOB_HEAP_ARITY;
+        if (!jobHeapLess(&node, &heap->nodes[parent])) {
+            break;
+        }
+        jobHeapPlace(heap, position, &heap->nodes[parent]);
+        position = parent;
+    }
+    jobHeapPlace(heap, position, &node);
+}
+
+// Moves a node down from a slot until it goes before all its children
+static void jobHeapSiftDown(job_heap_t* heap, size_t position, job_heap_node_t node)
+{
+    for (;;) {
+        size_t first = position * JOB_HEAP_ARITY + 1;
+        if (first >= heap->count) {
+            break;
+        }
+        size_t last = first + JOB_HEAP_ARITY < heap->count ? first + JOB_HEAP_ARITY : heap->count;
+        size_t child = first;
+        for (size_t i = first + 1; i < last; i++) {
+            if (jobHeapLess(&heap->nodes[i], &heap->nodes[child])) {
+                child = i;
+            }
+        }
+        if (!jobHeapLess(&heap->nodes[child], &node)) {
+            break;
+        }
+        jobHeapPlace(heap, position, &heap->nodes[child]);
+        position = child;
+    }
+    jobHeapPlace(heap, position, &node);
+}
+
+// Creates and returns an empty heap
+job_heap_t* jobHeapCreate(void)
+{
+    job_heap_t* heap = calloc(1, sizeof(job_heap_t));
+    if (heap == NULL) {
+        return NULL;
+    }
+    heap->nodes = malloc(JOB_HEAP_INITIAL_CAPACITY * sizeof(job_heap_node_t));
+    heap->jobs = malloc(JOB_HEAP_INITIAL_CAPACITY * sizeof(job_heap_job_t));
+    if (heap->nodes == NULL || heap->jobs == NULL) {
+        jobHeapDestroy(heap);
+        return NULL;
+    }
+    heap->capacity = JOB_HEAP_INITIAL_CAPACITY;
+    heap->freeHandle = JOB_HEAP_NONE;
+    return heap;
+}
+
+// Destroys a heap
+void jobHeapDestroy(job_heap_t* heap)
+{
+    free(heap->nodes);
+    free(heap->jobs);
+    free(heap);
+}
+
+// Adds a job to the heap
+// key - job size or remaining time
+// id - job id
+// remaining - remaining work
+// Returns the job's handle or JOB_HEAP_NONE on failure
+size_t jobHeapPush(job_heap_t* heap, uint64_t key, uint64_t id, uint64_t remaining)
+{
+    size_t handle = heap->freeHandle;
+    if (handle != JOB_HEAP_NONE) {
+        heap->freeHandle = heap->jobs[handle].position;
+    } else {
+        // Every handle is in use, so the heap is full
+        if (heap->numHandles == heap->capacity) {
+            size_t capacity = 2 * heap->capacity;
+            job_heap_node_t* nodes = realloc(heap->nodes, capacity * sizeof(job_heap_node_t));
+            if (nodes == NULL) {
+                return JOB_HEAP_NONE;
+            }
+            heap->nodes = nodes;
+            job_heap_job_t* jobs = realloc(heap->jobs, capacity * sizeof(job_heap_job_t));
+            if (jobs == NULL) {
+                return JOB_HEAP_NONE;
+            }
+            heap->jobs = jobs;
+            heap->capacity = capacity;
+        }
+        handle = heap->numHandles++;
+    }
+    heap->jobs[handle].remaining = remaining;
+    job_heap_node_t node = {key, id, handle};
+    jobHeapSiftUp(heap, heap->count++, node);
+    return handle;
+}
+
+// Removes a job from the heap, its handle may be reused by the next push
+void jobHeapRemove(job_heap_t* heap, size_t handle)
+{
+    size_t position = heap->jobs[handle].position;
+    job_heap_node_t last = heap->nodes[--heap->count];
+    heap->jobs[handle].position = heap->freeHandle;
+    heap->freeHandle = handle;
+    if (position == heap->count) {
+        return;
+    }
+    // The last node fills the hole, moving whichever way its key calls for
+    if (position > 0 && jobHeapLess(&last, &heap->nodes[(position - 1) / JOB_HEAP_ARITY])) {
+        jobHeapSiftUp(heap, position, last);
+    } else {
+        jobHeapSiftDown(heap, position, last);
+    }
+}
+
+// Changes the key of a job in the heap
+void jobHeapUpdate(job_heap_t* heap, size_t handle, uint64_t key)
+{
+    size_t position = heap->jobs[handle].position;
+    job_heap_node_t node = heap->nodes[position];
+    bool decreased = key < node.key;
+    node.key = key;
+    if (decreased) {
+        jobHeapSiftUp(heap, position, node);
+    } else {
+        jobHeapSiftDown(heap, position, node);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef JOB_HEAP_H
+#define JOB_HEAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Indexed d-ary min-heap of jobs keyed on (key, id)
+// The key is the job size or remaining time, and the id breaks ties the way the
+// sorted queues of the size-based policies do. Every job gets a handle that stays
+// valid while it is in the heap; a position map from handles to heap slots lets a
+// job anywhere in the heap be removed or re-keyed in O(log n), which is what
+// completing or preempting the job in service needs. Handles of removed jobs are
+// reused, so the heap and the map stay as large as the most jobs held at once.
+
+// Children per heap node, four keep a node's children in one or two cache lines
+#define JOB_HEAP_ARITY 4
+
+// Handle of no job
+#define JOB_HEAP_NONE SIZE_MAX
+
+// Heap slot
+typedef struct {
+    uint64_t key; // job size or remaining time
+    uint64_t id; // job id, orders jobs with equal keys
+    size_t handle; // handle of the job
+} job_heap_node_t;
+
+// Job by handle
+typedef struct {
+    size_t position; // heap slot of the job, next free handle for a free handle
+    uint64_t remaining; // remaining work
+} job_heap_job_t;
+
+typedef struct {
+    job_heap_node_t* nodes; // heap slots, smallest (key, id) first
+    size_t count; // number of jobs in the heap
+    job_heap_job_t* jobs; // jobs by handle
+    size_t capacity; // allocated slots and handles
+    size_t freeHandle; // first free handle below capacity, JOB_HEAP_NONE if there is none
+    size_t numHandles; // handles handed out so far
+} job_heap_t;
+
+// Creates and returns an empty heap
+job_heap_t* jobHeapCreate(void);
+
+// Destroys a heap
+void jobHeapDestroy(job_heap_t* heap);
+
+// Adds a job to the heap
+// key - job size or remaining time
+// id - job id
+// remaining - remaining work
+// Returns the job's handle or JOB_HEAP_NONE on failure
+size_t jobHeapPush(job_heap_t* heap, uint64_t key, uint64_t id, uint64_t remaining);
+
+// Removes a job from the heap, its handle may be reused by the next push
+void jobHeapRemove(job_heap_t* heap, size_t handle);
+
+// Changes the key of a job in the heap
+void jobHeapUpdate(job_heap_t* heap, size_t handle, uint64_t key);
+
+// Returns the handle of the job with the smallest (key, id), JOB_HEAP_NONE if empty
+static inline size_t jobHeapTop(job_heap_t* heap)
+{
+    return heap->count ? heap->nodes[0].handle : JOB_HEAP_NONE;
+}
+
+// Returns the key of a job in the heap
+static inline uint64_t jobHeapKey(job_heap_t* heap, size_t handle)
+{
+    return heap->nodes[heap->jobs[handle].position].key;
+}
+
+// Returns the id of a job in the heap
+static inline uint64_t jobHeapId(job_heap_t* heap, size_t handle)
+{
+    return heap->nodes[heap->jobs[handle].position].id;
+}
+
+// Returns the remaining work of a job in the heap
+static inline uint64_t jobHeapRemaining(job_heap_t* heap, size_t handle)
+{
+    return heap->jobs[handle].remaining;
+}
+
+// Sets the remaining work of a job in the heap, the job's key is not changed
+static inline void jobHeapSetRemaining(job_heap_t* heap, size_t handle, uint64_t remaining)
+{
+    heap->jobs[handle].remaining = remaining;
+}
+
+// Returns number of jobs in the heap
+static inline size_t jobHeapCount(job_heap_t* heap)
+{
+    return heap->count;
+}
+
+#endif /* JOB_HEAP_H */
@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "jobIndex.h"
+
+// Slots of a new index, a power of two
+#define JOB_INDEX_INITIAL_CAPACITY 16
+
+// Returns the home slot of a job id, Fibonacci hashing spreads consecutive ids
+static inline size_t jobIndexSlot(job_index_t* index, uint64_t id)
+{
+    return (size_t)((id * UINT64_C(0x9E3779B97F4A7C15)) >> index->shift);
+}
+
+// Allocates the slots of an index
+// Returns true on success, false otherwise
+static bool jobIndexAllocate(job_index_t* index, size_t capacity)
+{
+    index->ids = malloc(capacity * sizeof(uint64_t));
+    index->nodes = calloc(capacity, sizeof(list_node_t*));
+    if (index->ids == NULL || index->nodes == NULL) {
+        free(index->ids);
+        free(index->nodes);
+        return false;
+    }
+    index->capacity = capacity;
+    index->shift = 64;
+    for (size_t slots = capacity; slots > 1; slots >>= 1) {
+        index->shift--;
+    }
+    return true;
+}
+
+// Stores an entry in the first free slot of its probe run
+static void jobIndexPlace(job_index_t* index, uint64_t id, list_node_t* node)
+{
+    size_t mask = index->capacity - 1;
+    size_t slot = jobIndexSlot(index, id);
+    while (index->nodes[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    index->ids[slot] = id;
+    index->nodes[slot] = node;
+}
+
+// Doubles the number of slots
+// Returns true on success, false otherwise
+static bool jobIndexGrow(job_index_t* index)
+{
+    job_index_t old = *index;
+    if (!jobIndexAllocate(index, 2 * old.capacity)) {
+        *index = old;
+        return false;
+    }
+    for (size_t i = 0; i < old.capacity; i++) {
+        if (old.nodes[i] != NULL) {
+            jobIndexPlace(index, old.ids[i], old.nodes[i]);
+        }
+    }
+    free(old.ids);
+    free(old.nodes);
+    return true;
+}
+
+// Creates and returns an empty index
+job_index_t* jobIndexCreate(void)
+{
+    job_index_t* index = malloc(sizeof(job_index_t));
+    if (index == NULL) {
+        return NULL;
+    }
+    if (!jobIndexAllocate(index, JOB_INDEX_INITIAL_CAPACITY)) {
+        free(index);
+        return NULL;
+    }
+    index->count = 0;
+    return index;
+}
+
+// Destroys an index, the queue nodes are not touched
+void jobIndexDestroy(job_index_t* index)
+{
+    free(index->ids);
+    free(index->nodes);
+    free(index);
+}
+
+// Adds a job's queue node to the index
+// index - index
+// id - job id, must not be in the index already
+// node - queue node of the job
+// Returns true on success, false otherwise
+bool jobIndexInsert(job_index_t* index, uint64_t id, list_node_t* node)
+{
+    if (2 * (index->count + 1) > index->capacity && !jobIndexGrow(index)) {
+        return false;
+    }
+    jobIndexPlace(index, id, node);
+    index->count++;
+    return true;
+}
+
+// Finds a job's queue node
+// Returns the node or NULL if the job is not in the index
+list_node_t* jobIndexFind(job_index_t* index, uint64_t id)
+{
+    size_t mask = index->capacity - 1;
+    for (size_t slot = jobIndexSlot(index, id); index->nodes[slot] != NULL; slot = (slot + 1) & mask) {
+        if (index->ids[slot] == id) {
+            return index->nodes[slot];
+        }
+    }
+    return NULL;
+}
+
+// Removes a job from the index
+// Returns the job's queue node or NULL if the job is not in the index
+list_node_t* jobIndexRemove(job_index_t* index, uint64_t id)
+{
+    size_t mask = index->capacity - 1;
+    size_t slot = jobIndexSlot(index, id);
+    while (index->nodes[slot] != NULL && index->ids[slot] != id) {
+        slot = (slot + 1) & mask;
+    }
+    list_node_t* node = index->nodes[slot];
+    if (node == NULL) {
+        return NULL;
+    }
+    // Shift back every later entry of the run that may not skip the emptied slot
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; index->nodes[next] != NULL; next = (next + 1) & mask) {
+        size_t home = jobIndexSlot(index, index->ids[next]);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index->ids[hole] = index->ids[next];
+            index->nodes[hole] = index->nodes[next];
+            hole = next;
+        }
+    }
+    index->nodes[hole] = NULL;
+    index->count--;
+    return node;
+}
+
+// Inserts data into a queue and indexes its node under a job id
+// Returns the new node or NULL on failure, in which case neither is changed
+list_node_t* jobIndexListInsert(job_index_t* index, list_t* list, uint64_t id, void* data)
+{
+    list_node_t* node = list_insert(list, data);
+    if (node != NULL && !jobIndexInsert(index, id, node)) {
+        list_remove(list, node);
+        return NULL;
+    }
+    return node;
+}
+
+// Removes the node of a job id from a queue and the index
+// Returns the node's data or NULL if the job is not in the index
+void* jobIndexListRemove(job_index_t* index, list_t* list, uint64_t id)
+{
+    list_node_t* node = jobIndexRemove(index, id);
+    if (node == NULL) {
+        return NULL;
+    }
+    void* data = list_data(node);
+    list_remove(list, node);
+    return data;
+}
@@ -0,0 +1,56 @@
+#ifndef JOB_INDEX_H
+#define JOB_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "linked_list.h"
+
+// Hash index from job id to the job's node in a queue
+// Open addressing with linear probing; removal shifts the following entries of the
+// probe run back, so there are no tombstones and lookups stay short after many
+// removals. The table doubles when it gets half full.
+typedef struct {
+    uint64_t* ids; // job id per slot
+    list_node_t** nodes; // queue node per slot, NULL for an empty slot
+    size_t capacity; // number of slots, a power of two
+    unsigned shift; // 64 - log2(capacity), for the multiplicative hash
+    size_t count; // number of jobs in the index
+} job_index_t;
+
+// Creates and returns an empty index
+job_index_t* jobIndexCreate(void);
+
+// Destroys an index, the queue nodes are not touched
+void jobIndexDestroy(job_index_t* index);
+
+// Adds a job's queue node to the index
+// index - index
+// id - job id, must not be in the index already
+// node - queue node of the job
+// Returns true on success, false otherwise
+bool jobIndexInsert(job_index_t* index, uint64_t id, list_node_t* node);
+
+// Finds a job's queue node
+// Returns the node or NULL if the job is not in the index
+list_node_t* jobIndexFind(job_index_t* index, uint64_t id);
+
+// Removes a job from the index
+// Returns the job's queue node or NULL if the job is not in the index
+list_node_t* jobIndexRemove(job_index_t* index, uint64_t id);
+
+// Inserts data into a queue and indexes its node under a job id
+// Returns the new node or NULL on failure, in which case neither is changed
+list_node_t* jobIndexListInsert(job_index_t* index, list_t* list, uint64_t id, void* data);
+
+// Removes the node of a job id from a queue and the index
+// Returns the node's data or NULL if the job is not in the index
+void* jobIndexListRemove(job_index_t* index, list_t* list, uint64_t id);
+
+// Returns number of jobs in the index
+static inline size_t jobIndexCount(job_index_t* index)
+{
+    return index->count;
+}
+
+#endif /* JOB_INDEX_H */
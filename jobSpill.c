@@ -0,0 +1,216 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "jobSpill.h"
+
+// Smallest number of records per in-memory block
+#define JOB_SPILL_MIN_BLOCK 2
+
+// Segments of a new queue
+#define JOB_SPILL_INITIAL_SEGMENTS 16
+
+// Extra bytes of a segment path past the directory
+#define JOB_SPILL_PATH_EXTRA 24
+
+// Creates and returns an empty queue
+// dir - directory in which a private directory for the segment files is created
+// memoryRecords - records kept in memory, split over the head and tail blocks
+// Returns the queue or NULL on failure
+job_spill_t* jobSpillCreate(const char* dir, size_t memoryRecords)
+{
+    job_spill_t* queue = calloc(1, sizeof(job_spill_t));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->blockSize = memoryRecords / 2 > JOB_SPILL_MIN_BLOCK ? memoryRecords / 2 : JOB_SPILL_MIN_BLOCK;
+    size_t len = strlen(dir) + sizeof("/jobSpill.XXXXXX");
+    queue->dir = malloc(len);
+    queue->path = malloc(len + JOB_SPILL_PATH_EXTRA);
+    queue->head = malloc(queue->blockSize * sizeof(job_spill_record_t));
+    queue->tail = malloc(queue->blockSize * sizeof(job_spill_record_t));
+    queue->segments = malloc(JOB_SPILL_INITIAL_SEGMENTS * sizeof(job_spill_segment_t));
+    queue->segmentCapacity = JOB_SPILL_INITIAL_SEGMENTS;
+    if (queue->dir == NULL || queue->path == NULL || queue->head == NULL || queue->tail == NULL || queue->segments == NULL) {
+        free(queue->dir);
+        queue->dir = NULL;
+        jobSpillDestroy(queue);
+        return NULL;
+    }
+    snprintf(queue->dir, len, "%s/jobSpill.XXXXXX", dir);
+    if (mkdtemp(queue->dir) == NULL) {
+        printf("Failed to create spill directory in %s\n", dir);
+        free(queue->dir);
+        queue->dir = NULL;
+        jobSpillDestroy(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+// Builds the path of a segment file in the queue's path buffer
+static const char* jobSpillPath(job_spill_t* queue, uint64_t number)
+{
+    snprintf(queue->path, strlen(queue->dir) + JOB_SPILL_PATH_EXTRA, "%s/%" PRIu64, queue->dir, number);
+    return queue->path;
+}
+
+// Destroys a queue and deletes its segment files
+void jobSpillDestroy(job_spill_t* queue)
+{
+    if (queue->dir != NULL) {
+        for (size_t i = 0; i < queue->numSegments; i++) {
+            unlink(jobSpillPath(queue, queue->segments[(queue->segmentStart + i) % queue->segmentCapacity].number));
+        }
+        rmdir(queue->dir);
+    }
+    free(queue->dir);
+    free(queue->path);
+    free(queue->head);
+    free(queue->tail);
+    free(queue->segments);
+    free(queue);
+}
+
+// Writes the older half of the tail block to a new segment at the back of the disk
+// part of the queue
+// Returns true on success, false otherwise
+static bool jobSpillWriteTail(job_spill_t* queue)
+{
+    if (queue->numSegments == queue->segmentCapacity) {
+        // Unroll the ring into a larger one
+        size_t capacity = 2 * queue->segmentCapacity;
+        job_spill_segment_t* segments = malloc(capacity * sizeof(job_spill_segment_t));
+        if (segments == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < queue->numSegments; i++) {
+            segments[i] = queue->segments[(queue->segmentStart + i) % queue->segmentCapacity];
+        }
+        free(queue->segments);
+        queue->segments = segments;
+        queue->segmentStart = 0;
+        queue->segmentCapacity = capacity;
+    }
+    // Keeping the newer half in memory means a LIFO pushing and popping around a
+    // full block does not write and read a segment on every step
+    size_t count = queue->tailCount / 2;
+    uint64_t number = queue->nextSegment;
+    FILE* file = fopen(jobSpillPath(queue, number), "w");
+    if (file == NULL) {
+        printf("Failed to write spill segment: %s\n", queue->path);
+        return false;
+    }
+    bool success = fwrite(queue->tail, sizeof(job_spill_record_t), count, file) == count;
+    if (fclose(file) != 0 || !success) {
+        printf("Failed to write spill segment: %s\n", queue->path);
+        unlink(queue->path);
+        return false;
+    }
+    job_spill_segment_t* segment = &queue->segments[(queue->segmentStart + queue->numSegments) % queue->segmentCapacity];
+    segment->number = number;
+    segment->count = count;
+    queue->numSegments++;
+    queue->nextSegment++;
+    memmove(queue->tail, queue->tail + count, (queue->tailCount - count) * sizeof(job_spill_record_t));
+    queue->tailCount -= count;
+    return true;
+}
+
+// Reads a segment into a block and deletes its file
+// Returns true on success, false otherwise
+static bool jobSpillReadSegment(job_spill_t* queue, const job_spill_segment_t* segment, job_spill_record_t* block)
+{
+    FILE* file = fopen(jobSpillPath(queue, segment->number), "r");
+    bool success = file != NULL && fread(block, sizeof(job_spill_record_t), segment->count, file) == segment->count;
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (!success) {
+        printf("Failed to read spill segment: %s\n", queue->path);
+        return false;
+    }
+    unlink(queue->path);
+    return true;
+}
+
+// Swaps the head and tail blocks once the head block is empty, moving the tail
+// records to the front
+static void jobSpillSwapBlocks(job_spill_t* queue)
+{
+    job_spill_record_t* head = queue->head;
+    queue->head = queue->tail;
+    queue->tail = head;
+    queue->headStart = 0;
+    queue->headCount = queue->tailCount;
+    queue->tailCount = 0;
+}
+
+// Adds a record at the back of the queue
+// Returns true on success, false if a segment could not be written
+bool jobSpillPushBack(job_spill_t* queue, const job_spill_record_t* record)
+{
+    if (queue->tailCount == queue->blockSize) {
+        if (queue->headCount == 0 && queue->numSegments == 0) {
+            jobSpillSwapBlocks(queue);
+        } else if (!jobSpillWriteTail(queue)) {
+            return false;
+        }
+    }
+    queue->tail[queue->tailCount++] = *record;
+    queue->count++;
+    return true;
+}
+
+// Removes the record at the front of the queue
+// Returns true on success, false if the queue is empty or a segment could not be read
+bool jobSpillPopFront(job_spill_t* queue, job_spill_record_t* record)
+{
+    if (queue->headCount == 0) {
+        if (queue->numSegments > 0) {
+            job_spill_segment_t* segment = &queue->segments[queue->segmentStart];
+            if (!jobSpillReadSegment(queue, segment, queue->head)) {
+                return false;
+            }
+            queue->headStart = 0;
+            queue->headCount = segment->count;
+            queue->segmentStart = (queue->segmentStart + 1) % queue->segmentCapacity;
+            queue->numSegments--;
+        } else if (queue->tailCount > 0) {
+            jobSpillSwapBlocks(queue);
+        } else {
+            return false;
+        }
+    }
+    *record = queue->head[queue->headStart++];
+    queue->headCount--;
+    queue->count--;
+    return true;
+}
+
+// Removes the record at the back of the queue
+// Returns true on success, false if the queue is empty or a segment could not be read
+bool jobSpillPopBack(job_spill_t* queue, job_spill_record_t* record)
+{
+    if (queue->tailCount == 0) {
+        if (queue->numSegments > 0) {
+            job_spill_segment_t* segment = &queue->segments[(queue->segmentStart + queue->numSegments - 1) % queue->segmentCapacity];
+            if (!jobSpillReadSegment(queue, segment, queue->tail)) {
+                return false;
+            }
+            queue->tailCount = segment->count;
+            queue->numSegments--;
+        } else if (queue->headCount > 0) {
+            *record = queue->head[queue->headStart + --queue->headCount];
+            queue->count--;
+            return true;
+        } else {
+            return false;
+        }
+    }
+    *record = queue->tail[--queue->tailCount];
+    queue->count--;
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef JOB_SPILL_H
+#define JOB_SPILL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Queue of waiting jobs that spills to disk
+// The oldest records are kept in a head block and the newest in a tail block; when
+// the tail block fills up, its older half is written to a segment file, so the middle
+// of a long queue lives on disk in sequential segments. Popping at the front reads
+// the oldest segment back once the head block is empty, popping at the back the
+// newest once the tail block is empty, so a FIFO or a LIFO touches the disk once per
+// half block of records and memory stays at two blocks however long the queue grows.
+// The records are those of jobs that have not started, which is all a FIFO or LIFO
+// of waiting jobs needs to recreate them.
+
+// Waiting job
+typedef struct {
+    uint64_t id; // job id
+    uint64_t arrivalTime; // arrival time
+    uint64_t jobTime; // job size
+} job_spill_record_t;
+
+// Segment of records on disk
+typedef struct {
+    uint64_t number; // segment file name
+    size_t count; // number of records
+} job_spill_segment_t;
+
+typedef struct {
+    char* dir; // private directory of the segment files
+    char* path; // buffer for segment file paths
+    size_t blockSize; // records per in-memory block
+    job_spill_record_t* head; // oldest records in memory
+    size_t headStart; // first record in the head block
+    size_t headCount; // records in the head block
+    job_spill_record_t* tail; // newest records in memory
+    size_t tailCount; // records in the tail block
+    job_spill_segment_t* segments; // ring of segments on disk, oldest first
+    size_t segmentStart; // oldest segment in the ring
+    size_t numSegments; // number of segments
+    size_t segmentCapacity; // allocated segments
+    uint64_t nextSegment; // file name of the next segment
+    size_t count; // number of records in the queue
+} job_spill_t;
+
+// Creates and returns an empty queue
+// dir - directory in which a private directory for the segment files is created
+// memoryRecords - records kept in memory, split over the head and tail blocks
+// Returns the queue or NULL on failure
+job_spill_t* jobSpillCreate(const char* dir, size_t memoryRecords);
+
+// Destroys a queue and deletes its segment files
+void jobSpillDestroy(job_spill_t* queue);
+
+// Adds a record at the back of the queue
+// Returns true on success, false if a segment could not be written
+bool jobSpillPushBack(job_spill_t* queue, const job_spill_record_t* record);
+
+// Removes the record at the front of the queue
+// Returns true on success, false if the queue is empty or a segment could not be read
+bool jobSpillPopFront(job_spill_t* queue, job_spill_record_t* record);
+
+// Removes the record at the back of the queue
+// Returns true on success, false if the queue is empty or a segment could not be read
+bool jobSpillPopBack(job_spill_t* queue, job_spill_record_t* record);
+
+// Returns number of records in the queue
+static inline size_t jobSpillCount(job_spill_t* queue)
+{
+    return queue->count;
+}
+
+#endif /* JOB_SPILL_H */
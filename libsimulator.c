@@ -0,0 +1,438 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "libsimulator.h"
+#include "simulator.h"
+#include "scheduler.h"
+#include "dispatcher.h"
+#include "job.h"
+
+// Pushed jobs wait in a FIFO until they arrive, and only the front one has an
+// arrival event, the same as the next line of a trace file, so the order of events
+// and the completions are those of a trace run with the same jobs.
+
+// Completions a branch sends through its pipe at a time
+#define SIMULATION_BRANCH_BATCH 256
+
+struct simulation {
+    simulator_t* sim; // simulator
+    scheduler_t* scheduler; // scheduler (NULL when running a dispatcher)
+    dispatcher_t* dispatcher; // dispatcher (NULL when running a single queue)
+    job_t** pending; // ring of pushed jobs that have not arrived
+    size_t pendingHead; // index of the front pending job
+    size_t numPending; // number of pending jobs
+    size_t pendingCapacity; // ring size, a power of two
+    bool arrivalScheduled; // the front pending job has an arrival event
+    uint64_t lastArrival; // arrival time of the last pushed job
+    simulation_completion_fn completionCallback; // function to call upon job completion
+    void* completionCallbackData; // data to pass to callback
+    simulation_completion_t* completions; // ring of kept completions
+    size_t completionsHead; // index of the oldest kept completion
+    size_t numCompletions; // number of kept completions
+    size_t completionsCapacity; // ring size, a power of two
+    bool failed; // a completion could not be kept, the simulator is stopped
+};
+
+// Completions of a branch on their way to the calling process
+typedef struct {
+    int fd; // write end of the branch's pipe
+    simulation_completion_t records[SIMULATION_BRANCH_BATCH]; // completions not sent yet
+    size_t count; // number of completions not sent yet
+    bool failed; // a write failed
+} simulation_branch_writer_t;
+
+// Completions of a branch arriving in the calling process
+typedef struct {
+    pid_t pid; // branch process
+    int fd; // read end of the branch's pipe, -1 once closed
+    simulation_completion_t records[SIMULATION_BRANCH_BATCH]; // received completions
+    size_t length; // bytes received into records
+} simulation_branch_reader_t;
+
+// Reports a completed job
+// A completion that cannot be kept stops the simulation, since it would be lost
+static void simulationComplete(simulation_t* simulation, job_t* job, uint64_t completionTime)
+{
+    uint64_t id = jobGetId(job);
+    jobDestroy(job);
+    if (simulation->completionCallback) {
+        simulation->completionCallback(simulation->completionCallbackData, id, completionTime);
+        return;
+    }
+    if (simulation->numCompletions == simulation->completionsCapacity) {
+        // Double the ring and unwrap it
+        size_t capacity = simulation->completionsCapacity ? 2 * simulation->completionsCapacity : 64;
+        simulation_completion_t* completions = malloc(capacity * sizeof(simulation_completion_t));
+        if (completions == NULL) {
+            simulation->failed = true;
+            simulatorStop(simulation->sim);
+            return;
+        }
+        for (size_t i = 0; i < simulation->numCompletions; i++) {
+            completions[i] = simulation->completions[(simulation->completionsHead + i) & (simulation->completionsCapacity - 1)];
+        }
+        free(simulation->completions);
+        simulation->completions = completions;
+        simulation->completionsHead = 0;
+        simulation->completionsCapacity = capacity;
+    }
+    simulation_completion_t* completion = &simulation->completions[(simulation->completionsHead + simulation->numCompletions++) & (simulation->completionsCapacity - 1)];
+    completion->id = id;
+    completion->completionTime = completionTime;
+}
+
+// Called when a job completes at the scheduler
+static void simulationSchedulerCompletionCallback(void* s, job_t* job)
+{
+    simulation_t* simulation = (simulation_t*)s;
+    simulationComplete(simulation, job, simulatorSimTime(simulation->sim));
+}
+
+// Called when a job completes at a dispatcher queue
+static void simulationDispatcherCompletionCallback(void* s, job_t* job, uint64_t completionTime)
+{
+    simulationComplete((simulation_t*)s, job, completionTime);
+}
+
+static void simulationArrivalCallback(void* s);
+
+// Schedules the arrival of the front pending job, if any
+static void simulationScheduleNextArrival(simulation_t* simulation)
+{
+    if (simulation->numPending == 0) {
+        simulation->arrivalScheduled = false;
+        return;
+    }
+    job_t* job = simulation->pending[simulation->pendingHead];
+    list_node_t* eventRef = simulatorSchedule(simulation->sim, jobGetArrivalTime(job), EVENT_ARRIVAL, simulationArrivalCallback, simulation);
+    assert(eventRef);
+    simulation->arrivalScheduled = true;
+}
+
+// Called when the front pending job arrives
+static void simulationArrivalCallback(void* s)
+{
+    simulation_t* simulation = (simulation_t*)s;
+    job_t* job = simulation->pending[simulation->pendingHead];
+    simulation->pendingHead = (simulation->pendingHead + 1) & (simulation->pendingCapacity - 1);
+    simulation->numPending--;
+    if (simulation->dispatcher) {
+        dispatcherScheduleJob(simulation->dispatcher, job);
+    } else {
+        schedulerScheduleJob(simulation->scheduler, job);
+    }
+    simulationScheduleNextArrival(simulation);
+}
+
+// Creates a simulation
+// schedulerName - name of scheduler, optionally followed by ":params"
+// options - number of queues and routing policy, or NULL for a single queue; the
+//           engine and trace file options are not used
+// completionCallback - function to call upon job completion, or NULL to keep the
+//                      completions for simulationTakeCompletions
+// completionCallbackData - data to pass to the callback
+// Returns the simulation or NULL on failure
+simulation_t* simulationCreate(const char* schedulerName, const trace_options_t* options, simulation_completion_fn completionCallback, void* completionCallbackData)
+{
+    simulation_t* simulation = calloc(1, sizeof(simulation_t));
+    if (simulation == NULL) {
+        return NULL;
+    }
+    simulation->completionCallback = completionCallback;
+    simulation->completionCallbackData = completionCallbackData;
+    simulation->sim = simulatorCreate();
+    if (simulation->sim == NULL) {
+        free(simulation);
+        return NULL;
+    }
+    if (options && options->numQueues > 1) {
+        simulation->dispatcher = dispatcherCreate(options->routerName, schedulerName, options->numQueues, &simulation->sim, 1, &options->routerOptions,
+                                                  simulationDispatcherCompletionCallback, simulation);
+    } else {
+        simulation->scheduler = schedulerCreate(schedulerName, simulation->sim, simulationSchedulerCompletionCallback, simulation);
+    }
+    if (simulation->scheduler == NULL && simulation->dispatcher == NULL) {
+        simulatorDestroy(simulation->sim);
+        free(simulation);
+        return NULL;
+    }
+    return simulation;
+}
+
+// Destroys a simulation, jobs that have not completed are dropped
+void simulationDestroy(simulation_t* simulation)
+{
+    if (simulation->dispatcher) {
+        dispatcherDestroy(simulation->dispatcher);
+    } else {
+        schedulerDestroy(simulation->scheduler);
+    }
+    simulatorDestroy(simulation->sim);
+    for (size_t i = 0; i < simulation->numPending; i++) {
+        jobDestroy(simulation->pending[(simulation->pendingHead + i) & (simulation->pendingCapacity - 1)]);
+    }
+    free(simulation->pending);
+    free(simulation->completions);
+    free(simulation);
+}
+
+// Adds a job to arrive at the given time
+// The arrival time may not be before the current time or the last pushed arrival
+// Returns true on success, false otherwise
+bool simulationPushJob(simulation_t* simulation, uint64_t id, uint64_t arrivalTime, uint64_t jobTime)
+{
+    if (arrivalTime < simulatorSimTime(simulation->sim) || arrivalTime < simulation->lastArrival) {
+        return false;
+    }
+    if (simulation->numPending == simulation->pendingCapacity) {
+        // Double the ring and unwrap it
+        size_t capacity = simulation->pendingCapacity ? 2 * simulation->pendingCapacity : 64;
+        job_t** pending = malloc(capacity * sizeof(job_t*));
+        if (pending == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < simulation->numPending; i++) {
+            pending[i] = simulation->pending[(simulation->pendingHead + i) & (simulation->pendingCapacity - 1)];
+        }
+        free(simulation->pending);
+        simulation->pending = pending;
+        simulation->pendingHead = 0;
+        simulation->pendingCapacity = capacity;
+    }
+    job_t* job = jobCreate(arrivalTime, jobTime, id);
+    if (job == NULL) {
+        return false;
+    }
+    simulation->pending[(simulation->pendingHead + simulation->numPending++) & (simulation->pendingCapacity - 1)] = job;
+    simulation->lastArrival = arrivalTime;
+    if (!simulation->arrivalScheduled) {
+        simulationScheduleNextArrival(simulation);
+    }
+    return true;
+}
+
+// Runs all events up to and including the given time
+// Jobs pushed afterwards may still arrive at that time
+// Returns true on success, false if a completion could not be kept, after which
+// the simulation runs no further events
+bool simulationAdvance(simulation_t* simulation, uint64_t timestamp)
+{
+    simulatorRunUntil(simulation->sim, timestamp);
+    return !simulation->failed;
+}
+
+// Runs until every pushed job has completed
+// Returns true on success, false if a completion could not be kept, after which
+// the simulation runs no further events
+bool simulationRunAll(simulation_t* simulation)
+{
+    simulatorRun(simulation->sim);
+    return !simulation->failed;
+}
+
+// Returns the current simulated time
+uint64_t simulationTime(simulation_t* simulation)
+{
+    return simulatorSimTime(simulation->sim);
+}
+
+// Moves kept completions into the caller's buffer in completion order
+// buffer - completions buffer
+// capacity - number of completions the buffer holds
+// Returns the number of completions moved
+size_t simulationTakeCompletions(simulation_t* simulation, simulation_completion_t* buffer, size_t capacity)
+{
+    size_t count = simulation->numCompletions < capacity ? simulation->numCompletions : capacity;
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = simulation->completions[(simulation->completionsHead + i) & (simulation->completionsCapacity - 1)];
+    }
+    if (count > 0) {
+        simulation->completionsHead = (simulation->completionsHead + count) & (simulation->completionsCapacity - 1);
+        simulation->numCompletions -= count;
+    }
+    return count;
+}
+
+// Writes all bytes to a descriptor
+// Returns true on success, false otherwise
+static bool simulationWriteAll(int fd, const void* data, size_t length)
+{
+    const char* bytes = (const char*)data;
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+// Sends the buffered completions of a branch
+static void simulationBranchFlush(simulation_branch_writer_t* writer)
+{
+    if (writer->count > 0 && !simulationWriteAll(writer->fd, writer->records, writer->count * sizeof(simulation_completion_t))) {
+        writer->failed = true;
+    }
+    writer->count = 0;
+}
+
+// Called when a job completes in a branch
+static void simulationBranchCompletionCallback(void* w, uint64_t id, uint64_t completionTime)
+{
+    simulation_branch_writer_t* writer = (simulation_branch_writer_t*)w;
+    writer->records[writer->count].id = id;
+    writer->records[writer->count].completionTime = completionTime;
+    if (++writer->count == SIMULATION_BRANCH_BATCH) {
+        simulationBranchFlush(writer);
+    }
+}
+
+// Runs a branch in the forked process and exits
+static void simulationBranchRun(simulation_t* simulation, size_t branch, simulation_branch_fn branchFn, void* branchData, int fd)
+{
+    simulation_branch_writer_t* writer = malloc(sizeof(simulation_branch_writer_t));
+    if (writer == NULL) {
+        _exit(1);
+    }
+    writer->fd = fd;
+    writer->count = 0;
+    writer->failed = false;
+    // Completions kept before the branch belong to the calling process
+    simulation->numCompletions = 0;
+    simulation->completionCallback = simulationBranchCompletionCallback;
+    simulation->completionCallbackData = writer;
+    branchFn(simulation, branch, branchData);
+    simulationBranchFlush(writer);
+    fflush(NULL);
+    _exit(writer->failed ? 1 : 0);
+}
+
+// Receives completions from a branch until its pipe would block or is closed
+static void simulationBranchReceive(simulation_branch_reader_t* reader, size_t branch, simulation_branch_completion_fn completionCallback, void* completionCallbackData)
+{
+    char* buffer = (char*)reader->records;
+    ssize_t received = read(reader->fd, buffer + reader->length, sizeof(reader->records) - reader->length);
+    if (received < 0 && errno == EINTR) {
+        return;
+    }
+    if (received <= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+        return;
+    }
+    reader->length += (size_t)received;
+    size_t count = reader->length / sizeof(simulation_completion_t);
+    for (size_t i = 0; i < count; i++) {
+        completionCallback(completionCallbackData, branch, reader->records[i].id, reader->records[i].completionTime);
+    }
+    // Keep a partly received completion for the next read
+    reader->length -= count * sizeof(simulation_completion_t);
+    memmove(buffer, buffer + count * sizeof(simulation_completion_t), reader->length);
+}
+
+// Runs what-if branches from the current state of a simulation in parallel
+// Every branch runs in a forked process on a copy-on-write copy of the simulation,
+// so warming up a state once serves any number of branches, whatever scheduler
+// runs. Completions stream back to the calling process through pipes; the
+// simulation itself is left unchanged.
+// simulation - simulation to branch from
+// numBranches - number of branches
+// branchFn - function run in every branch
+// branchData - data to pass to the branch function
+// completionCallback - function to call upon job completion in a branch
+// completionCallbackData - data to pass to the callback
+// Returns true if every branch ran to the end, false otherwise
+bool simulationBranch(simulation_t* simulation, size_t numBranches, simulation_branch_fn branchFn, void* branchData,
+                      simulation_branch_completion_fn completionCallback, void* completionCallbackData)
+{
+    simulation_branch_reader_t* readers = malloc(numBranches * sizeof(simulation_branch_reader_t));
+    struct pollfd* pollFds = malloc(numBranches * sizeof(struct pollfd));
+    if (readers == NULL || pollFds == NULL) {
+        free(readers);
+        free(pollFds);
+        return false;
+    }
+    // Output buffered before the fork would otherwise be written by every branch
+    fflush(NULL);
+    bool success = true;
+    size_t numStarted = 0;
+    for (; numStarted < numBranches; numStarted++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            success = false;
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for (size_t i = 0; i < numStarted; i++) {
+                if (readers[i].fd >= 0) {
+                    close(readers[i].fd);
+                }
+            }
+            simulationBranchRun(simulation, numStarted, branchFn, branchData, fds[1]);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            success = false;
+            break;
+        }
+        readers[numStarted].pid = pid;
+        readers[numStarted].fd = fds[0];
+        readers[numStarted].length = 0;
+    }
+
+    for (;;) {
+        nfds_t numOpen = 0;
+        for (size_t i = 0; i < numStarted; i++) {
+            if (readers[i].fd >= 0) {
+                pollFds[numOpen].fd = readers[i].fd;
+                pollFds[numOpen].events = POLLIN;
+                numOpen++;
+            }
+        }
+        if (numOpen == 0) {
+            break;
+        }
+        if (poll(pollFds, numOpen, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            success = false;
+            break;
+        }
+        nfds_t next = 0;
+        for (size_t i = 0; i < numStarted; i++) {
+            if (readers[i].fd >= 0 && pollFds[next++].revents) {
+                simulationBranchReceive(&readers[i], i, completionCallback, completionCallbackData);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < numStarted; i++) {
+        if (readers[i].fd >= 0) {
+            close(readers[i].fd);
+        }
+        int status = 0;
+        pid_t waited;
+        while ((waited = waitpid(readers[i].pid, &status, 0)) < 0 && errno == EINTR) {
+        }
+        if (waited < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || readers[i].length != 0) {
+            success = false;
+        }
+    }
+    free(readers);
+    free(pollFds);
+    return success;
+}
@@ -0,0 +1,99 @@
+#ifndef LIBSIMULATOR_H
+#define LIBSIMULATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "trace.h"
+
+// Embeddable simulation
+// A simulation runs one scheduler, or several queues behind a dispatcher, on jobs
+// pushed from memory instead of a trace file. Jobs must be pushed in arrival order,
+// and time only moves forward when the caller advances it, so a long-running
+// service can keep a simulation open and feed it as jobs become known. Completions
+// go to a callback, or are kept until the caller takes them into its own buffer.
+// Built as libsimulator.a and libsimulator.so by "make lib".
+
+typedef struct simulation simulation_t;
+
+// Completed job
+typedef struct {
+    uint64_t id; // job id
+    uint64_t completionTime; // time at which the job completed
+} simulation_completion_t;
+
+// Called when a job completes
+// completionCallbackData - data passed to simulationCreate
+// id - job id
+// completionTime - time at which the job completed
+typedef void (*simulation_completion_fn)(void* completionCallbackData, uint64_t id, uint64_t completionTime);
+
+// Creates a simulation
+// schedulerName - name of scheduler, optionally followed by ":params"
+// options - number of queues and routing policy, or NULL for a single queue; the
+//           engine and trace file options are not used
+// completionCallback - function to call upon job completion, or NULL to keep the
+//                      completions for simulationTakeCompletions
+// completionCallbackData - data to pass to the callback
+// Returns the simulation or NULL on failure
+simulation_t* simulationCreate(const char* schedulerName, const trace_options_t* options, simulation_completion_fn completionCallback, void* completionCallbackData);
+
+// Destroys a simulation, jobs that have not completed are dropped
+void simulationDestroy(simulation_t* simulation);
+
+// Adds a job to arrive at the given time
+// The arrival time may not be before the current time or the last pushed arrival
+// Returns true on success, false otherwise
+bool simulationPushJob(simulation_t* simulation, uint64_t id, uint64_t arrivalTime, uint64_t jobTime);
+
+// Runs all events up to and including the given time
+// Jobs pushed afterwards may still arrive at that time
+// Returns true on success, false if a completion could not be kept, after which
+// the simulation runs no further events
+bool simulationAdvance(simulation_t* simulation, uint64_t timestamp);
+
+// Runs until every pushed job has completed
+// Returns true on success, false if a completion could not be kept, after which
+// the simulation runs no further events
+bool simulationRunAll(simulation_t* simulation);
+
+// Returns the current simulated time
+uint64_t simulationTime(simulation_t* simulation);
+
+// Moves kept completions into the caller's buffer in completion order
+// buffer - completions buffer
+// capacity - number of completions the buffer holds
+// Returns the number of completions moved
+size_t simulationTakeCompletions(simulation_t* simulation, simulation_completion_t* buffer, size_t capacity);
+
+// Runs one what-if branch from the state of a simulation
+// Branches may push jobs, advance and run the simulation they are given; their
+// completions go to the callback passed to simulationBranch
+// simulation - copy of the simulation in the branch
+// branch - index of the branch
+// branchData - data passed to simulationBranch
+typedef void (*simulation_branch_fn)(simulation_t* simulation, size_t branch, void* branchData);
+
+// Called when a job completes in a what-if branch
+// completionCallbackData - data passed to simulationBranch
+// branch - index of the branch
+// id - job id
+// completionTime - time at which the job completed
+typedef void (*simulation_branch_completion_fn)(void* completionCallbackData, size_t branch, uint64_t id, uint64_t completionTime);
+
+// Runs what-if branches from the current state of a simulation in parallel
+// Every branch runs in a forked process on a copy-on-write copy of the simulation,
+// so warming up a state once serves any number of branches, whatever scheduler
+// runs. Completions stream back to the calling process through pipes; the
+// simulation itself is left unchanged.
+// simulation - simulation to branch from
+// numBranches - number of branches
+// branchFn - function run in every branch
+// branchData - data to pass to the branch function
+// completionCallback - function to call upon job completion in a branch
+// completionCallbackData - data to pass to the callback
+// Returns true if every branch ran to the end, false otherwise
+bool simulationBranch(simulation_t* simulation, size_t numBranches, simulation_branch_fn branchFn, void* branchData,
+                      simulation_branch_completion_fn completionCallback, void* completionCallbackData);
+
+#endif /* LIBSIMULATOR_H */
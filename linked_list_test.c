@@ -8,6 +8,9 @@
 #include <stdbool.h>
 #include <math.h>
 #include "linked_list.h"
+#include "jobIndex.h"
+#include "jobSpill.h"
+#include "jobHeap.h"
 
 int tests_run = 0;
 #define mu_str_(text) #text
@@ -377,6 +380,161 @@ char* test_list_remove()
     return NULL;
 }
 
+char* test_job_index()
+{
+    job_index_t* index = jobIndexCreate();
+    mu_assert("test_job_index: Testing if index is not NULL", index != NULL);
+    mu_assert("test_job_index: Index count should be 0", jobIndexCount(index) == 0);
+    mu_assert("test_job_index: Finding in an empty index should return NULL", jobIndexFind(index, 7) == NULL);
+
+    // Enough ids to grow the table several times, with dummy nodes as values
+    list_node_t nodes[1000];
+    for (uint64_t i = 0; i < 1000; i++) {
+        mu_assert("test_job_index: Insert should succeed", jobIndexInsert(index, i * 3, &nodes[i]));
+    }
+    mu_assert("test_job_index: Index count should be 1000", jobIndexCount(index) == 1000);
+    for (uint64_t i = 0; i < 1000; i++) {
+        mu_assert("test_job_index: Inserted id should be found", jobIndexFind(index, i * 3) == &nodes[i]);
+        mu_assert("test_job_index: Id that was not inserted should not be found", jobIndexFind(index, i * 3 + 1) == NULL);
+    }
+
+    // Removing every other id must keep the rest of every probe run reachable
+    for (uint64_t i = 0; i < 1000; i += 2) {
+        mu_assert("test_job_index: Remove should return the node", jobIndexRemove(index, i * 3) == &nodes[i]);
+    }
+    mu_assert("test_job_index: Removing a missing id should return NULL", jobIndexRemove(index, 0) == NULL);
+    mu_assert("test_job_index: Index count should be 500", jobIndexCount(index) == 500);
+    for (uint64_t i = 0; i < 1000; i++) {
+        list_node_t* expected = (i % 2) ? &nodes[i] : NULL;
+        mu_assert("test_job_index: Only the ids that were not removed should be found", jobIndexFind(index, i * 3) == expected);
+    }
+
+    jobIndexDestroy(index);
+    return NULL;
+}
+
+char* test_job_index_list()
+{
+    list_t* list = list_create(NULL);
+    job_index_t* index = jobIndexCreate();
+    data_item_t data[5];
+    for (int i = 0; i < 5; i++) {
+        data[i].value = i + 1;
+        mu_assert("test_job_index_list: Insert should return a node", jobIndexListInsert(index, list, (uint64_t)data[i].value, &data[i]) != NULL);
+    }
+    mu_assert("test_job_index_list: List node count should be 5", list_count(list) == 5);
+    mu_assert("test_job_index_list: Index count should be 5", jobIndexCount(index) == 5);
+    mu_assert("test_job_index_list: Id 3 should map to the node holding 3", ((data_item_t*)list_data(jobIndexFind(index, 3)))->value == 3);
+
+    mu_assert("test_job_index_list: Removing id 3 should return its data", jobIndexListRemove(index, list, 3) == &data[2]);
+    mu_assert("test_job_index_list: List node count should be 4", list_count(list) == 4);
+    mu_assert("test_job_index_list: Id 3 should be gone from the index", jobIndexFind(index, 3) == NULL);
+    mu_assert("test_job_index_list: Removing id 3 again should return NULL", jobIndexListRemove(index, list, 3) == NULL);
+    mu_assert("test_job_index_list: Node after the removed one should hold 2", ((data_item_t*)list_data(list_next(list_find(list, &data[3]))))->value == 2);
+
+    jobIndexDestroy(index);
+    list_destroy(list);
+    return NULL;
+}
+
+char* test_job_spill()
+{
+    // Two records per block, so nearly everything goes through segment files
+    job_spill_t* queue = jobSpillCreate(".", 4);
+    mu_assert("test_job_spill: Testing if queue is not NULL", queue != NULL);
+    job_spill_record_t record;
+    mu_assert("test_job_spill: Popping an empty queue should fail", !jobSpillPopFront(queue, &record) && !jobSpillPopBack(queue, &record));
+
+    // FIFO
+    for (uint64_t i = 0; i < 1000; i++) {
+        job_spill_record_t pushed = {i, 2 * i, 3 * i};
+        mu_assert("test_job_spill: Push should succeed", jobSpillPushBack(queue, &pushed));
+    }
+    mu_assert("test_job_spill: Queue count should be 1000", jobSpillCount(queue) == 1000);
+    for (uint64_t i = 0; i < 1000; i++) {
+        mu_assert("test_job_spill: Pop front should succeed", jobSpillPopFront(queue, &record));
+        mu_assert("test_job_spill: Pop front should return the oldest record", record.id == i && record.arrivalTime == 2 * i && record.jobTime == 3 * i);
+    }
+    mu_assert("test_job_spill: Queue count should be 0", jobSpillCount(queue) == 0);
+
+    // LIFO with pushes and pops around the block boundaries
+    uint64_t stack[1000];
+    size_t depth = 0;
+    uint64_t next = 0;
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 20; i++) {
+            job_spill_record_t pushed = {next, next, next};
+            mu_assert("test_job_spill: Push should succeed", jobSpillPushBack(queue, &pushed));
+            stack[depth++] = next++;
+        }
+        for (int i = 0; i < 13 + round % 7; i++) {
+            mu_assert("test_job_spill: Pop back should succeed", jobSpillPopBack(queue, &record));
+            mu_assert("test_job_spill: Pop back should return the newest record", record.id == stack[--depth]);
+        }
+    }
+    mu_assert("test_job_spill: Queue count should match the pushes less the pops", jobSpillCount(queue) == depth);
+
+    // Mixed: the front gets the oldest remaining record
+    mu_assert("test_job_spill: Pop front should succeed", jobSpillPopFront(queue, &record));
+    mu_assert("test_job_spill: Pop front should return the oldest remaining record", record.id == stack[0]);
+
+    jobSpillDestroy(queue);
+    return NULL;
+}
+
+char* test_job_heap()
+{
+    job_heap_t* heap = jobHeapCreate();
+    mu_assert("test_job_heap: Testing if heap is not NULL", heap != NULL);
+    mu_assert("test_job_heap: Top of an empty heap should be none", jobHeapTop(heap) == JOB_HEAP_NONE);
+
+    // Keys repeat, so ids decide between equal keys
+    size_t handles[1000];
+    for (uint64_t i = 0; i < 1000; i++) {
+        handles[i] = jobHeapPush(heap, (i * 7919) % 100, i, 2 * i);
+        mu_assert("test_job_heap: Push should succeed", handles[i] != JOB_HEAP_NONE);
+    }
+    mu_assert("test_job_heap: Heap count should be 1000", jobHeapCount(heap) == 1000);
+    for (uint64_t i = 0; i < 1000; i++) {
+        mu_assert("test_job_heap: Handle should find its job", jobHeapId(heap, handles[i]) == i && jobHeapRemaining(heap, handles[i]) == 2 * i);
+    }
+
+    // Removing by handle and re-keying keep the heap order
+    for (uint64_t i = 0; i < 1000; i += 3) {
+        jobHeapRemove(heap, handles[i]);
+    }
+    for (uint64_t i = 1; i < 1000; i += 3) {
+        jobHeapUpdate(heap, handles[i], (i * 31) % 150);
+    }
+    uint64_t lastKey = 0;
+    uint64_t lastId = 0;
+    size_t popped = 0;
+    while (jobHeapCount(heap) > 0) {
+        size_t top = jobHeapTop(heap);
+        uint64_t key = jobHeapKey(heap, top);
+        uint64_t id = jobHeapId(heap, top);
+        mu_assert("test_job_heap: Removed jobs should not come back", id % 3 != 0);
+        mu_assert("test_job_heap: Jobs should come out in (key, id) order", popped == 0 || key > lastKey || (key == lastKey && id > lastId));
+        uint64_t expectedKey = id % 3 == 1 ? (id * 31) % 150 : (id * 7919) % 100;
+        mu_assert("test_job_heap: Job should have its latest key", key == expectedKey);
+        lastKey = key;
+        lastId = id;
+        jobHeapRemove(heap, top);
+        popped++;
+    }
+    mu_assert("test_job_heap: Every job that was not removed should come out", popped == 666);
+
+    // Handles of removed jobs are reused
+    size_t handle = jobHeapPush(heap, 5, 1, 5);
+    mu_assert("test_job_heap: Push after removal should reuse a handle", handle < 1000);
+    mu_assert("test_job_heap: Top should be the only job", jobHeapTop(heap) == handle);
+    jobHeapSetRemaining(heap, handle, 3);
+    mu_assert("test_job_heap: Setting the remaining work should keep the key", jobHeapRemaining(heap, handle) == 3 && jobHeapKey(heap, handle) == 5);
+
+    jobHeapDestroy(heap);
+    return NULL;
+}
+
 typedef char* (*test_fn_t)();
 typedef struct {
     char* name;
@@ -387,7 +545,11 @@ test_t tests[] = {
     {"test_list_create", test_list_create},
     {"test_list_insert", test_list_insert},
     {"test_list_find",   test_list_find},
-    {"test_list_remove", test_list_remove} 
+    {"test_list_remove", test_list_remove},
+    {"test_job_index", test_job_index},
+    {"test_job_index_list", test_job_index_list},
+    {"test_job_spill", test_job_spill},
+    {"test_job_heap", test_job_heap}
 };
  
 size_t num_tests = sizeof(tests)/sizeof(tests[0]);
@@ -1,38 +1,97 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
 #include "trace.h"
+#include "scheduler.h"
 
 // Print program usage info
 void usage(char* program)
 {
-    printf("%s traceFile outFile scheduler\n", program);
+    printf("%s traceFile outFile scheduler [options]\n", program);
     printf("Scheduler options:\n");
-    printf("FCFS\n");
-    printf("LCFS\n");
-    printf("SJF\n");
-    printf("PLCFS\n");
-    printf("PSJF\n");
-    printf("SRPT\n");
-    printf("PS\n");
-    printf("FB\n");
+    for (size_t i = 0; i < schedulerCount(); i++) {
+        const scheduler_descriptor_t* descriptor = schedulerGet(i);
+        const char* flags[] = {"", " [preemptive]", " [size-aware]", " [preemptive, size-aware]"};
+        printf("%-19s %s%s\n", descriptor->name, descriptor->description,
+               flags[descriptor->flags & (SCHEDULER_PREEMPTIVE | SCHEDULER_SIZE_AWARE)]);
+    }
+    printf("%-19s run every scheduler, writing outFile.SCHEDULER\n", "ALL");
+    printf("Options:\n");
+    printf("--engine=ENGINE     simulation engine: sequential, conservative, optimistic, busyperiod,\n"
+           "                    closedform (FCFS only), stack (LCFS and PLCFS only), heap (SJF, PSJF and SRPT\n"
+           "                    only) (default sequential)\n");
+    printf("--threads=N         threads used by parallel engines and BGZF trace decompression (default 1)\n");
+    printf("--window=W          simulated time the optimistic engine runs ahead of the GVT (default 64)\n");
+    printf("--queues=N          run N queues behind a dispatcher (default 1)\n");
+    printf("--route=ROUTER      dispatcher routing policy: RANDOM, RR, JSQ, POD, SITA (default RR)\n");
+    printf("--route-d=D         queues sampled per job by POD (default 2)\n");
+    printf("--sita-cutoffs=LIST comma separated ascending SITA size cutoffs (default powers of two)\n");
+    printf("--seed=S            seed for randomized routing policies (default 1)\n");
+    printf("--plugin=PATH       load schedulers from a shared object (may be repeated)\n");
+    printf("--prefetch          parse the trace ahead on a background thread\n");
+    printf("--generic-loop      run the sequential engine with the generic simulator loop\n");
+    printf("--stats             print events and events per second of the sequential engine\n");
+    printf("--cache=DIR         reuse outputs of earlier runs with the same trace, scheduler and options\n");
+    printf("--cache-limit=BYTES total size of cached outputs, least recently used go first (default 1GiB)\n");
+    printf("--follow            keep simulating as jobs are appended to the trace, until interrupted\n");
+    printf("--follow-idle=S     end follow mode after S seconds without new jobs (default 0, never)\n");
+    printf("--from=T            write only jobs arriving at or after time T, seeking with a sidecar index\n");
+    printf("--to=T              write only jobs arriving before time T\n");
+    printf("--spill=DIR         spill the waiting jobs to files in DIR (FCFS and LCFS only)\n");
+    printf("--spill-jobs=N      waiting jobs kept in memory when spilling (default 1048576)\n");
+    printf("--sample            print the time-average number in system and utilization\n");
+    printf("--sample-interval=T also write the averages over every T time units to outFile.samples\n");
+    printf("--counters[=SCOPE]  print hardware counters per million events of the sequential engine, read\n"
+           "                    around the run loop (run) or inside the policy's functions (policy) (default run)\n");
 }
 
-int main(int argc, char* argv[])
+// Parses an unsigned integer option value
+// Returns true on success, false otherwise
+static bool parseUint64(const char* str, uint64_t* value)
 {
-    if (argc != 4) {
-        usage(argv[0]);
-        return -1;
+    char* end;
+    if (*str == '\0' || *str == '-') {
+        return false;
     }
-    // Run the trace
-    const char* traceFile = argv[1];
-    const char* outFile = argv[2];
-    const char* schedulerName = argv[3];
-    if (!traceRun(traceFile, outFile, schedulerName)) {
-        usage(argv[0]);
-        return -2;
+    *value = strtoull(str, &end, 10);
+    return *end == '\0';
+}
+
+// Parses a comma separated list of unsigned integers
+// Returns the list on success (to be freed by the caller) or NULL otherwise
+static uint64_t* parseUint64List(const char* str, size_t* count)
+{
+    size_t n = 1;
+    for (const char* c = str; *c; c++) {
+        n += *c == ',';
+    }
+    uint64_t* list = malloc(n * sizeof(uint64_t));
+    if (list == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        char* end;
+        if (*str < '0' || *str > '9') {
+            free(list);
+            return NULL;
+        }
+        list[i] = strtoull(str, &end, 10);
+        if (*end != (i + 1 < n ? ',' : '\0')) {
+            free(list);
+            return NULL;
+        }
+        str = end + 1;
     }
-    // Sort the output file by job id
+    *count = n;
+    return list;
+}
+
+// Sorts an output file by job id
+// Returns the exit status of the sort command
+static int sortOutput(const char* outFile)
+{
     size_t len = 2*strlen(outFile) + strlen("sort -t, -k1n,1 -o  ") + 1;
     char* cmd = malloc(len);
     if (cmd == NULL) {
@@ -46,3 +105,177 @@ int main(int argc, char* argv[])
     free(cmd);
     return ret;
 }
+
+// Runs the trace with every registered scheduler, writing outFile.SCHEDULER
+// Only the schedulers that can spill are run with the spill directory
+// Returns 0 on success, -2 if a run failed, or the exit status of a failed sort
+static int runAllSchedulers(const char* traceFile, const char* outFile, const trace_options_t* options)
+{
+    for (size_t i = 0; i < schedulerCount(); i++) {
+        const char* schedulerName = schedulerGet(i)->name;
+        trace_options_t policyOptions = *options;
+        if (!schedulerSpillSupported(schedulerName)) {
+            policyOptions.spillDir = NULL;
+        }
+        size_t len = strlen(outFile) + strlen(schedulerName) + 2;
+        char* policyOutFile = malloc(len);
+        if (policyOutFile == NULL) {
+            return -2;
+        }
+        snprintf(policyOutFile, len, "%s.%s", outFile, schedulerName);
+        int ret = traceRunWithOptions(traceFile, policyOutFile, schedulerName, &policyOptions) ? sortOutput(policyOutFile) : -2;
+        free(policyOutFile);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option longOptions[] = {
+        {"engine", required_argument, NULL, 'e'},
+        {"threads", required_argument, NULL, 't'},
+        {"window", required_argument, NULL, 'w'},
+        {"queues", required_argument, NULL, 'q'},
+        {"route", required_argument, NULL, 'r'},
+        {"route-d", required_argument, NULL, 'd'},
+        {"sita-cutoffs", required_argument, NULL, 'c'},
+        {"seed", required_argument, NULL, 's'},
+        {"plugin", required_argument, NULL, 'p'},
+        {"prefetch", no_argument, NULL, 'f'},
+        {"generic-loop", no_argument, NULL, 'g'},
+        {"stats", no_argument, NULL, 'S'},
+        {"cache", required_argument, NULL, 'C'},
+        {"cache-limit", required_argument, NULL, 'L'},
+        {"follow", no_argument, NULL, 'F'},
+        {"follow-idle", required_argument, NULL, 'I'},
+        {"from", required_argument, NULL, 'm'},
+        {"to", required_argument, NULL, 'T'},
+        {"spill", required_argument, NULL, 'D'},
+        {"spill-jobs", required_argument, NULL, 'J'},
+        {"sample", no_argument, NULL, 'a'},
+        {"sample-interval", required_argument, NULL, 'n'},
+        {"counters", optional_argument, NULL, 'P'},
+        {NULL, 0, NULL, 0}
+    };
+    trace_options_t options;
+    traceOptionsInit(&options);
+    uint64_t* cutoffs = NULL;
+    uint64_t value;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        bool valid = true;
+        switch (opt) {
+        case 'e':
+            options.engineName = optarg;
+            break;
+        case 't':
+            valid = parseUint64(optarg, &value) && value > 0;
+            options.numThreads = (size_t)value;
+            break;
+        case 'w':
+            valid = parseUint64(optarg, &options.window) && options.window > 0;
+            break;
+        case 'q':
+            valid = parseUint64(optarg, &value) && value > 0;
+            options.numQueues = (size_t)value;
+            break;
+        case 'r':
+            options.routerName = optarg;
+            break;
+        case 'd':
+            valid = parseUint64(optarg, &value) && value > 0;
+            options.routerOptions.d = (size_t)value;
+            break;
+        case 'c':
+            free(cutoffs);
+            cutoffs = parseUint64List(optarg, &options.routerOptions.numCutoffs);
+            options.routerOptions.cutoffs = cutoffs;
+            valid = cutoffs != NULL;
+            break;
+        case 's':
+            valid = parseUint64(optarg, &options.routerOptions.seed);
+            break;
+        case 'p':
+            valid = schedulerLoadPlugin(optarg);
+            break;
+        case 'f':
+            options.prefetch = true;
+            break;
+        case 'g':
+            options.genericLoop = true;
+            break;
+        case 'S':
+            options.stats = true;
+            break;
+        case 'C':
+            options.cacheDir = optarg;
+            break;
+        case 'L':
+            valid = parseUint64(optarg, &options.cacheLimit);
+            break;
+        case 'F':
+            options.follow = true;
+            break;
+        case 'I':
+            valid = parseUint64(optarg, &options.followIdle);
+            break;
+        case 'm':
+            valid = parseUint64(optarg, &options.fromTime);
+            break;
+        case 'T':
+            valid = parseUint64(optarg, &options.toTime);
+            break;
+        case 'D':
+            options.spillDir = optarg;
+            break;
+        case 'J':
+            valid = parseUint64(optarg, &value) && value > 0;
+            options.spillJobs = (size_t)value;
+            break;
+        case 'a':
+            options.sample = true;
+            break;
+        case 'n':
+            valid = parseUint64(optarg, &options.sampleInterval) && options.sampleInterval > 0;
+            options.sample = true;
+            break;
+        case 'P':
+            options.counters = optarg ? optarg : "run";
+            break;
+        default:
+            valid = false;
+            break;
+        }
+        if (!valid) {
+            free(cutoffs);
+            usage(argv[0]);
+            schedulerUnloadPlugins();
+            return -1;
+        }
+    }
+    if (argc - optind != 3) {
+        free(cutoffs);
+        usage(argv[0]);
+        schedulerUnloadPlugins();
+        return -1;
+    }
+    // Run the trace
+    const char* traceFile = argv[optind];
+    const char* outFile = argv[optind + 1];
+    const char* schedulerName = argv[optind + 2];
+    int ret;
+    if (strcmp(schedulerName, "ALL") == 0) {
+        ret = runAllSchedulers(traceFile, outFile, &options);
+    } else {
+        ret = traceRunWithOptions(traceFile, outFile, schedulerName, &options) ? sortOutput(outFile) : -2;
+    }
+    if (ret == -2) {
+        usage(argv[0]);
+    }
+    free(cutoffs);
+    schedulerUnloadPlugins();
+    return ret;
+}
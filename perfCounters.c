@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "perfCounters.h"
+
+// Counter names and events, in the order of the values read
+static const struct {
+    const char* name; // counter name for reports
+    uint32_t type; // perf event type
+    uint64_t config; // perf event config
+} perfCountersEvents[PERF_COUNTERS_NUM] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1D misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"LLC misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// Opens a counter of the calling thread
+// groupFd - file descriptor of the group leader, -1 to open a leader
+// Returns the file descriptor or -1 on failure
+static int perfCountersOpen(size_t index, int groupFd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perfCountersEvents[index].type;
+    attr.config = perfCountersEvents[index].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Members follow the leader, which starts disabled
+    attr.disabled = groupFd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+// Opens the counters of the calling thread, stopped and at zero
+// Returns the counters, some or all of which may be unavailable, or NULL on failure
+perf_counters_t* perfCountersCreate(void)
+{
+    perf_counters_t* counters = malloc(sizeof(perf_counters_t));
+    if (counters == NULL) {
+        return NULL;
+    }
+    counters->leader = -1;
+    counters->error = 0;
+    for (size_t i = 0; i < PERF_COUNTERS_NUM; i++) {
+        counters->fds[i] = perfCountersOpen(i, counters->leader);
+        if (counters->fds[i] < 0) {
+            if (counters->error == 0) {
+                counters->error = errno;
+            }
+        } else if (counters->leader < 0) {
+            counters->leader = counters->fds[i];
+        }
+    }
+    if (counters->leader >= 0) {
+        ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    }
+    return counters;
+}
+
+// Closes the counters
+void perfCountersDestroy(perf_counters_t* counters)
+{
+    // Members before the leader
+    for (size_t i = PERF_COUNTERS_NUM; i-- > 0;) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+    }
+    free(counters);
+}
+
+// Returns the name of a counter
+const char* perfCountersName(size_t index)
+{
+    return perfCountersEvents[index].name;
+}
+
+// Reads the counters, scaled up if the group was multiplexed with other events
+// values - set to the counter values, PERF_COUNTERS_UNAVAILABLE for counters that
+//          are not available or never ran
+void perfCountersRead(perf_counters_t* counters, uint64_t values[PERF_COUNTERS_NUM])
+{
+    for (size_t i = 0; i < PERF_COUNTERS_NUM; i++) {
+        values[i] = PERF_COUNTERS_UNAVAILABLE;
+    }
+    if (counters->leader < 0) {
+        return;
+    }
+    // Number of counters, time enabled, time running, then the counts in the order
+    // the counters joined the group
+    uint64_t group[3 + PERF_COUNTERS_NUM];
+    ssize_t size = read(counters->leader, group, sizeof(group));
+    if (size < (ssize_t)(3 * sizeof(uint64_t)) || group[2] == 0) {
+        return;
+    }
+    double scale = (double)group[1] / (double)group[2];
+    size_t member = 0;
+    for (size_t i = 0; i < PERF_COUNTERS_NUM && member < group[0]; i++) {
+        if (counters->fds[i] >= 0) {
+            values[i] = (uint64_t)((double)group[3 + member++] * scale);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+// Hardware performance counters of the calling thread
+// The counters are opened with perf_event_open as one group, so they count over
+// exactly the same stretches of execution, and only user space is counted. A
+// counter the kernel or the processor does not offer is left out of the group and
+// read as unavailable; when none is offered, starting and stopping do nothing.
+
+// Number of counters
+#define PERF_COUNTERS_NUM 5
+
+// Value of a counter that is not available
+#define PERF_COUNTERS_UNAVAILABLE UINT64_MAX
+
+typedef struct {
+    int fds[PERF_COUNTERS_NUM]; // counter file descriptors, -1 for counters that are not available
+    int leader; // file descriptor of the group leader, -1 if no counter is available
+    int error; // errno of the first counter that failed to open
+} perf_counters_t;
+
+// Opens the counters of the calling thread, stopped and at zero
+// Returns the counters, some or all of which may be unavailable, or NULL on failure
+perf_counters_t* perfCountersCreate(void);
+
+// Closes the counters
+void perfCountersDestroy(perf_counters_t* counters);
+
+// Returns the name of a counter
+const char* perfCountersName(size_t index);
+
+// Reads the counters, scaled up if the group was multiplexed with other events
+// values - set to the counter values, PERF_COUNTERS_UNAVAILABLE for counters that
+//          are not available or never ran
+void perfCountersRead(perf_counters_t* counters, uint64_t values[PERF_COUNTERS_NUM]);
+
+// Starts counting
+static inline void perfCountersStart(perf_counters_t* counters)
+{
+    if (counters->leader >= 0) {
+        ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+// Stops counting, the counts are kept
+static inline void perfCountersStop(perf_counters_t* counters)
+{
+    if (counters->leader >= 0) {
+        ioctl(counters->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+#endif /* PERF_COUNTERS_H */
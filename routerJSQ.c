@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "dispatcher.h"
+#include "job.h"
+
+// Join the Shortest Queue (JSQ) routing
+// Queues are kept in a binary min-heap ordered by (length, index) with a position
+// map, so routing is O(1) and a queue length change is O(log n)
+typedef struct {
+    size_t* heap; // queue indices in heap order
+    size_t* position; // heap position of each queue
+} router_JSQ_t;
+
+// Returns true if queue a goes before queue b
+static inline bool routerJSQBefore(dispatcher_t* dispatcher, size_t a, size_t b)
+{
+    size_t lengthA = dispatcherQueueLength(dispatcher, a);
+    size_t lengthB = dispatcherQueueLength(dispatcher, b);
+    return lengthA < lengthB || (lengthA == lengthB && a < b);
+}
+
+// Swaps two heap entries and updates their positions
+static inline void routerJSQSwap(router_JSQ_t* info, size_t i, size_t j)
+{
+    size_t tmp = info->heap[i];
+    info->heap[i] = info->heap[j];
+    info->heap[j] = tmp;
+    info->position[info->heap[i]] = i;
+    info->position[info->heap[j]] = j;
+}
+
+// Creates and returns router specific info
+void* routerJSQCreate(dispatcher_t* dispatcher, const router_options_t* options)
+{
+    router_JSQ_t* info = malloc(sizeof(router_JSQ_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    size_t numQueues = dispatcherNumQueues(dispatcher);
+    info->heap = malloc(numQueues * sizeof(size_t));
+    info->position = malloc(numQueues * sizeof(size_t));
+    if (info->heap == NULL || info->position == NULL) {
+        free(info->heap);
+        free(info->position);
+        free(info);
+        return NULL;
+    }
+    // Queues start empty, so index order is a valid heap
+    for (size_t i = 0; i < numQueues; i++) {
+        info->heap[i] = i;
+        info->position[i] = i;
+    }
+    return info;
+}
+
+// Destroys router specific info
+void routerJSQDestroy(void* routerInfo)
+{
+    router_JSQ_t* info = (router_JSQ_t*)routerInfo;
+    free(info->heap);
+    free(info->position);
+    free(info);
+}
+
+// Called to pick the queue for a new job
+size_t routerJSQRouteJob(void* routerInfo, dispatcher_t* dispatcher, job_t* job)
+{
+    router_JSQ_t* info = (router_JSQ_t*)routerInfo;
+    return info->heap[0];
+}
+
+// Called after the length of a queue changed
+void routerJSQQueueUpdate(void* routerInfo, dispatcher_t* dispatcher, size_t queue)
+{
+    router_JSQ_t* info = (router_JSQ_t*)routerInfo;
+    size_t numQueues = dispatcherNumQueues(dispatcher);
+    size_t i = info->position[queue];
+    // Sift up
+    while (i > 0 && routerJSQBefore(dispatcher, info->heap[i], info->heap[(i - 1) / 2])) {
+        routerJSQSwap(info, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    // Sift down
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < numQueues && routerJSQBefore(dispatcher, info->heap[left], info->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < numQueues && routerJSQBefore(dispatcher, info->heap[right], info->heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        routerJSQSwap(info, i, smallest);
+        i = smallest;
+    }
+}
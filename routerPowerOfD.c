@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "dispatcher.h"
+#include "job.h"
+
+// Power-of-d choices routing
+// Samples d queues uniformly at random and picks the shortest, O(d) per job
+// Ties go to the queue sampled first
+typedef struct {
+    size_t d; // number of queues sampled per job
+} router_PowerOfD_t;
+
+// Creates and returns router specific info
+void* routerPowerOfDCreate(dispatcher_t* dispatcher, const router_options_t* options)
+{
+    router_PowerOfD_t* info = malloc(sizeof(router_PowerOfD_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    info->d = options->d ? options->d : 1;
+    return info;
+}
+
+// Destroys router specific info
+void routerPowerOfDDestroy(void* routerInfo)
+{
+    free(routerInfo);
+}
+
+// Called to pick the queue for a new job
+size_t routerPowerOfDRouteJob(void* routerInfo, dispatcher_t* dispatcher, job_t* job)
+{
+    router_PowerOfD_t* info = (router_PowerOfD_t*)routerInfo;
+    size_t numQueues = dispatcherNumQueues(dispatcher);
+    size_t best = dispatcherRandom(dispatcher, numQueues);
+    for (size_t i = 1; i < info->d; i++) {
+        size_t queue = dispatcherRandom(dispatcher, numQueues);
+        if (dispatcherQueueLength(dispatcher, queue) < dispatcherQueueLength(dispatcher, best)) {
+            best = queue;
+        }
+    }
+    return best;
+}
+
+// Called after the length of a queue changed
+void routerPowerOfDQueueUpdate(void* routerInfo, dispatcher_t* dispatcher, size_t queue)
+{
+}
@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "dispatcher.h"
+#include "job.h"
+
+// Round-Robin (RR) routing
+// RR router info
+typedef struct {
+    size_t next; // queue receiving the next job
+} router_RR_t;
+
+// Creates and returns router specific info
+void* routerRRCreate(dispatcher_t* dispatcher, const router_options_t* options)
+{
+    router_RR_t* info = malloc(sizeof(router_RR_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    info->next = 0;
+    return info;
+}
+
+// Destroys router specific info
+void routerRRDestroy(void* routerInfo)
+{
+    free(routerInfo);
+}
+
+// Called to pick the queue for a new job
+size_t routerRRRouteJob(void* routerInfo, dispatcher_t* dispatcher, job_t* job)
+{
+    router_RR_t* info = (router_RR_t*)routerInfo;
+    size_t queue = info->next;
+    info->next = queue + 1 == dispatcherNumQueues(dispatcher) ? 0 : queue + 1;
+    return queue;
+}
+
+// Called after the length of a queue changed
+void routerRRQueueUpdate(void* routerInfo, dispatcher_t* dispatcher, size_t queue)
+{
+}
@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "dispatcher.h"
+#include "job.h"
+
+// Uniform random routing
+// Random routing keeps no state besides the dispatcher's random number generator
+
+// Creates and returns router specific info
+void* routerRandomCreate(dispatcher_t* dispatcher, const router_options_t* options)
+{
+    return dispatcher;
+}
+
+// Destroys router specific info
+void routerRandomDestroy(void* routerInfo)
+{
+}
+
+// Called to pick the queue for a new job
+size_t routerRandomRouteJob(void* routerInfo, dispatcher_t* dispatcher, job_t* job)
+{
+    return dispatcherRandom(dispatcher, dispatcherNumQueues(dispatcher));
+}
+
+// Called after the length of a queue changed
+void routerRandomQueueUpdate(void* routerInfo, dispatcher_t* dispatcher, size_t queue)
+{
+}
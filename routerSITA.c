@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "dispatcher.h"
+#include "job.h"
+
+// Size Interval Task Assignment (SITA) routing
+// Queue i serves jobs with size in (cutoff[i-1], cutoff[i]], the last queue serves
+// everything above the last cutoff. Without explicit cutoffs, queue i serves sizes
+// up to 2^i. Routing is a binary search over the cutoffs, O(log n)
+typedef struct {
+    uint64_t* cutoffs; // size cutoffs in ascending order
+    size_t numCutoffs; // number of size cutoffs
+} router_SITA_t;
+
+// Creates and returns router specific info
+void* routerSITACreate(dispatcher_t* dispatcher, const router_options_t* options)
+{
+    router_SITA_t* info = malloc(sizeof(router_SITA_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    info->cutoffs = NULL;
+    info->numCutoffs = options->cutoffs ? options->numCutoffs : 0;
+    if (info->numCutoffs > 0) {
+        info->cutoffs = malloc(info->numCutoffs * sizeof(uint64_t));
+        if (info->cutoffs == NULL) {
+            free(info);
+            return NULL;
+        }
+        for (size_t i = 0; i < info->numCutoffs; i++) {
+            info->cutoffs[i] = options->cutoffs[i];
+            if (i > 0 && info->cutoffs[i] < info->cutoffs[i - 1]) {
+                free(info->cutoffs);
+                free(info);
+                return NULL;
+            }
+        }
+    }
+    return info;
+}
+
+// Destroys router specific info
+void routerSITADestroy(void* routerInfo)
+{
+    router_SITA_t* info = (router_SITA_t*)routerInfo;
+    free(info->cutoffs);
+    free(info);
+}
+
+// Called to pick the queue for a new job
+size_t routerSITARouteJob(void* routerInfo, dispatcher_t* dispatcher, job_t* job)
+{
+    router_SITA_t* info = (router_SITA_t*)routerInfo;
+    uint64_t size = jobGetJobTime(job);
+    size_t queue;
+    if (info->cutoffs == NULL) {
+        // Smallest i with size <= 2^i
+        queue = size <= 1 ? 0 : (size_t)(64 - __builtin_clzll(size - 1));
+    } else {
+        // Number of cutoffs below the size
+        size_t low = 0;
+        size_t high = info->numCutoffs;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (info->cutoffs[mid] < size) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        queue = low;
+    }
+    size_t numQueues = dispatcherNumQueues(dispatcher);
+    return queue < numQueues ? queue : numQueues - 1;
+}
+
+// Called after the length of a queue changed
+void routerSITAQueueUpdate(void* routerInfo, dispatcher_t* dispatcher, size_t queue)
+{
+}
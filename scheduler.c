@@ -1,51 +1,315 @@
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
 #include "scheduler.h"
 #include "simulator.h"
 #include "job.h"
 
+// Built-in scheduling policies
+static const scheduler_descriptor_t schedulerBuiltins[] = {
+    SCHEDULER_DESCRIPTOR(FCFS, 0, "first come first served"),
+    SCHEDULER_DESCRIPTOR(LCFS, 0, "last come first served"),
+    SCHEDULER_DESCRIPTOR(SJF, SCHEDULER_SIZE_AWARE, "shortest job first"),
+    SCHEDULER_DESCRIPTOR(PLCFS, SCHEDULER_PREEMPTIVE, "preemptive last come first served"),
+    SCHEDULER_DESCRIPTOR(PSJF, SCHEDULER_PREEMPTIVE | SCHEDULER_SIZE_AWARE, "preemptive shortest job first"),
+    SCHEDULER_DESCRIPTOR(SRPT, SCHEDULER_PREEMPTIVE | SCHEDULER_SIZE_AWARE, "shortest remaining processing time"),
+    SCHEDULER_DESCRIPTOR(PS, SCHEDULER_PREEMPTIVE, "processor sharing"),
+    SCHEDULER_DESCRIPTOR(FB, SCHEDULER_PREEMPTIVE, "foreground-background, least attained service first"),
+    SCHEDULER_DESCRIPTOR_CONFIGURE_BATCH(RR, SCHEDULER_PREEMPTIVE, "round robin, RR[:quantum] (default quantum 4)"),
+    SCHEDULER_DESCRIPTOR_CONFIGURE_BATCH(MLFQ, SCHEDULER_PREEMPTIVE, "multi-level feedback queue, MLFQ[:q0,q1,...] (default 2,4,8,16)"),
+};
+
+// Registered scheduling policies with a perfect hash of their names
+typedef struct {
+    const scheduler_descriptor_t** descriptors; // policies in registration order
+    void** owners; // plugin that registered each policy (NULL if built in)
+    size_t count; // number of policies
+    size_t capacity; // allocated policies
+    const scheduler_descriptor_t** slots; // hash table without collisions
+    size_t numSlots; // number of slots, a power of two
+    unsigned shift; // hash bits dropped to get a slot
+    uint64_t seed; // hash seed without collisions
+    void** plugins; // loaded plugins
+    size_t numPlugins; // number of loaded plugins
+    void* loading; // plugin being initialized
+} scheduler_registry_t;
+
+static scheduler_registry_t schedulerRegistry;
+static pthread_once_t schedulerRegistryOnce = PTHREAD_ONCE_INIT;
+
+// Hashes a policy name
+static uint64_t schedulerNameHash(const char* name, size_t length, uint64_t seed)
+{
+    // FNV-1a over the name, then a multiply-xorshift so the top bits are well mixed
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Rebuilds the hash table by searching for a seed without collisions
+// Returns true on success, false otherwise
+static bool schedulerRegistryRehash(scheduler_registry_t* registry)
+{
+    size_t numSlots = 2;
+    unsigned bits = 1;
+    while (numSlots < 2 * registry->count) {
+        numSlots *= 2;
+        bits++;
+    }
+    for (;;) {
+        const scheduler_descriptor_t** slots = calloc(numSlots, sizeof(scheduler_descriptor_t*));
+        if (slots == NULL) {
+            return false;
+        }
+        for (uint64_t seed = 0; seed < 64; seed++) {
+            bool collision = false;
+            for (size_t i = 0; i < registry->count && !collision; i++) {
+                const char* name = registry->descriptors[i]->name;
+                size_t slot = (size_t)(schedulerNameHash(name, strlen(name), seed) >> (64 - bits));
+                collision = slots[slot] != NULL;
+                slots[slot] = registry->descriptors[i];
+            }
+            if (!collision) {
+                free(registry->slots);
+                registry->slots = slots;
+                registry->numSlots = numSlots;
+                registry->shift = 64 - bits;
+                registry->seed = seed;
+                return true;
+            }
+            memset(slots, 0, numSlots * sizeof(scheduler_descriptor_t*));
+        }
+        // Too crowded, retry with a larger table
+        free(slots);
+        numSlots *= 2;
+        bits++;
+    }
+}
+
+// Looks up a policy by the first length characters of its name
+static const scheduler_descriptor_t* schedulerRegistryLookup(scheduler_registry_t* registry, const char* name, size_t length)
+{
+    if (registry->slots == NULL) {
+        return NULL;
+    }
+    const scheduler_descriptor_t* descriptor = registry->slots[schedulerNameHash(name, length, registry->seed) >> registry->shift];
+    if (descriptor && strncmp(descriptor->name, name, length) == 0 && descriptor->name[length] == '\0') {
+        return descriptor;
+    }
+    return NULL;
+}
+
+// Adds a policy to the registry
+// Returns true on success, false otherwise
+static bool schedulerRegistryAdd(scheduler_registry_t* registry, const scheduler_descriptor_t* descriptor)
+{
+    if (schedulerRegistryLookup(registry, descriptor->name, strlen(descriptor->name))) {
+        printf("Scheduler already registered: %s\n", descriptor->name);
+        return false;
+    }
+    if (registry->count == registry->capacity) {
+        size_t capacity = registry->capacity ? 2 * registry->capacity : 16;
+        const scheduler_descriptor_t** descriptors = realloc(registry->descriptors, capacity * sizeof(scheduler_descriptor_t*));
+        if (descriptors == NULL) {
+            return false;
+        }
+        registry->descriptors = descriptors;
+        void** owners = realloc(registry->owners, capacity * sizeof(void*));
+        if (owners == NULL) {
+            return false;
+        }
+        registry->owners = owners;
+        registry->capacity = capacity;
+    }
+    registry->descriptors[registry->count] = descriptor;
+    registry->owners[registry->count] = registry->loading;
+    registry->count++;
+    if (!schedulerRegistryRehash(registry)) {
+        registry->count--;
+        return false;
+    }
+    return true;
+}
+
+// Registers the built-in policies
+static void schedulerRegistryInit(void)
+{
+    for (size_t i = 0; i < sizeof(schedulerBuiltins) / sizeof(schedulerBuiltins[0]); i++) {
+        schedulerRegistryAdd(&schedulerRegistry, &schedulerBuiltins[i]);
+    }
+}
+
+// Registers a scheduling policy
+// descriptor - policy descriptor, must stay valid while the policy is registered
+// Returns true on success, false if the name is taken or on failure
+bool schedulerRegister(const scheduler_descriptor_t* descriptor)
+{
+    pthread_once(&schedulerRegistryOnce, schedulerRegistryInit);
+    return schedulerRegistryAdd(&schedulerRegistry, descriptor);
+}
+
+// Finds a registered scheduling policy in O(1)
+// schedulerName - name of scheduler, optionally followed by ":params"
+// Returns the descriptor or NULL if there is no such policy
+const scheduler_descriptor_t* schedulerFind(const char* schedulerName)
+{
+    pthread_once(&schedulerRegistryOnce, schedulerRegistryInit);
+    return schedulerRegistryLookup(&schedulerRegistry, schedulerName, strcspn(schedulerName, ":"));
+}
+
+// Returns the number of registered scheduling policies
+size_t schedulerCount(void)
+{
+    pthread_once(&schedulerRegistryOnce, schedulerRegistryInit);
+    return schedulerRegistry.count;
+}
+
+// Returns the registered scheduling policy at the given index in registration order
+const scheduler_descriptor_t* schedulerGet(size_t index)
+{
+    pthread_once(&schedulerRegistryOnce, schedulerRegistryInit);
+    return index < schedulerRegistry.count ? schedulerRegistry.descriptors[index] : NULL;
+}
+
+// Returns true if a policy is built in rather than registered by a plugin
+bool schedulerIsBuiltin(const scheduler_descriptor_t* descriptor)
+{
+    for (size_t i = 0; i < sizeof(schedulerBuiltins) / sizeof(schedulerBuiltins[0]); i++) {
+        if (descriptor == &schedulerBuiltins[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Loads a shared object and calls its SCHEDULER_PLUGIN_INIT function
+// Returns true on success, false otherwise
+bool schedulerLoadPlugin(const char* path)
+{
+    pthread_once(&schedulerRegistryOnce, schedulerRegistryInit);
+    scheduler_registry_t* registry = &schedulerRegistry;
+    void** plugins = realloc(registry->plugins, (registry->numPlugins + 1) * sizeof(void*));
+    if (plugins == NULL) {
+        return false;
+    }
+    registry->plugins = plugins;
+    void* plugin = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (plugin == NULL) {
+        printf("Failed to load scheduler plugin: %s\n", dlerror());
+        return false;
+    }
+    scheduler_plugin_init_fn init;
+    *(void**)&init = dlsym(plugin, SCHEDULER_PLUGIN_INIT);
+    if (init == NULL) {
+        printf("Scheduler plugin has no %s function: %s\n", SCHEDULER_PLUGIN_INIT, path);
+        dlclose(plugin);
+        return false;
+    }
+    registry->plugins[registry->numPlugins++] = plugin;
+    registry->loading = plugin;
+    bool success = init();
+    registry->loading = NULL;
+    return success;
+}
+
+// Unloads all plugins and unregisters their policies
+void schedulerUnloadPlugins(void)
+{
+    scheduler_registry_t* registry = &schedulerRegistry;
+    if (registry->numPlugins == 0) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < registry->count; i++) {
+        if (registry->owners[i] == NULL) {
+            registry->descriptors[count] = registry->descriptors[i];
+            registry->owners[count] = NULL;
+            count++;
+        }
+    }
+    registry->count = count;
+    if (!schedulerRegistryRehash(registry)) {
+        // Without a table lookups fail, so never leave one pointing at unloaded policies
+        free(registry->slots);
+        registry->slots = NULL;
+    }
+    for (size_t i = 0; i < registry->numPlugins; i++) {
+        dlclose(registry->plugins[i]);
+    }
+    free(registry->plugins);
+    registry->plugins = NULL;
+    registry->numPlugins = 0;
+}
+
 // Creates a scheduler
-// schedulerName - name of scheduler
+// schedulerName - name of scheduler, optionally followed by ":params" (e.g. "RR:8")
 // sim - simulator
 // completionCallback - function to call upon job completion
 // completionCallbackData - data to pass to completionCallback
 // Returns scheduler on success or NULL otherwise
 scheduler_t* schedulerCreate(const char* schedulerName, simulator_t* sim, completionCallback_fn completionCallback, void* completionCallbackData)
+{
+    const scheduler_descriptor_t* descriptor = schedulerFind(schedulerName);
+    if (descriptor == NULL) {
+        printf("Invalid scheduler type: %.*s\n", (int)strcspn(schedulerName, ":"), schedulerName);
+        return NULL;
+    }
+    const char* params = strchr(schedulerName, ':');
+    if (params && descriptor->configure == NULL) {
+        printf("Scheduler takes no parameters: %s\n", schedulerName);
+        return NULL;
+    }
+    void* schedulerInfo = descriptor->create();
+    if (schedulerInfo == NULL) {
+        return NULL;
+    }
+    if (params && !descriptor->configure(schedulerInfo, params + 1)) {
+        printf("Invalid scheduler parameters: %s\n", schedulerName);
+        descriptor->destroy(schedulerInfo);
+        return NULL;
+    }
+    return schedulerCreateWithInfo(descriptor, schedulerInfo, sim, completionCallback, completionCallbackData);
+}
+
+// Creates a scheduler around scheduler specific info that was already created
+// descriptor - policy descriptor, its create function is not called
+// schedulerInfo - scheduler specific info, destroyed on failure
+// sim - simulator
+// completionCallback - function to call upon job completion
+// completionCallbackData - data to pass to completionCallback
+// Returns scheduler on success or NULL otherwise
+scheduler_t* schedulerCreateWithInfo(const scheduler_descriptor_t* descriptor, void* schedulerInfo, simulator_t* sim,
+                                     completionCallback_fn completionCallback, void* completionCallbackData)
 {
     scheduler_t* scheduler = malloc(sizeof(scheduler_t));
     if (scheduler == NULL) {
+        descriptor->destroy(schedulerInfo);
         return NULL;
     }
+    scheduler->create = descriptor->create;
+    scheduler->destroy = descriptor->destroy;
+    scheduler->scheduleJob = descriptor->scheduleJob;
+    scheduler->scheduleJobBatch = descriptor->scheduleJobBatch;
+    scheduler->completeJob = descriptor->completeJob;
+    scheduler->configure = descriptor->configure;
     scheduler->sim = sim;
     scheduler->completionCallback = completionCallback;
     scheduler->completionCallbackData = completionCallbackData;
     scheduler->completionEvent = NULL;
-    if (strcmp(schedulerName, "FCFS") == 0) {
-        INIT_SCHEDULER(scheduler, FCFS);
-    } else if (strcmp(schedulerName, "LCFS") == 0) {
-        INIT_SCHEDULER(scheduler, LCFS);
-    } else if (strcmp(schedulerName, "SJF") == 0) {
-        INIT_SCHEDULER(scheduler, SJF);
-    } else if (strcmp(schedulerName, "PLCFS") == 0) {
-        INIT_SCHEDULER(scheduler, PLCFS);
-    } else if (strcmp(schedulerName, "PSJF") == 0) {
-        INIT_SCHEDULER(scheduler, PSJF);
-    } else if (strcmp(schedulerName, "SRPT") == 0) {
-        INIT_SCHEDULER(scheduler, SRPT);
-    } else if (strcmp(schedulerName, "PS") == 0) {
-        INIT_SCHEDULER(scheduler, PS);
-    } else if (strcmp(schedulerName, "FB") == 0) {
-        INIT_SCHEDULER(scheduler, FB);
-    } else {
-        printf("Invalid scheduler type: %s\n", schedulerName);
-        free(scheduler);
-        return NULL;
-    }
-    scheduler->schedulerInfo = scheduler->create();
-    if (scheduler->schedulerInfo == NULL) {
-        free(scheduler);
-        return NULL;
-    }
+    scheduler->completionCancelled = false;
+    scheduler->schedulerInfo = schedulerInfo;
+    scheduler->sampler = NULL;
+    scheduler->numJobs = 0;
+    scheduler->counters = NULL;
     return scheduler;
 }
 
@@ -53,7 +317,7 @@ scheduler_t* schedulerCreate(const char* schedulerName, simulator_t* sim, comple
 void schedulerDestroy(scheduler_t* scheduler)
 {
     if (scheduler->completionEvent) {
-        schedulerCancelNextCompletion(scheduler);
+        simulatorRemoveEvent(scheduler->sim, scheduler->completionEvent);
     }
     scheduler->destroy(scheduler->schedulerInfo);
     free(scheduler);
@@ -62,26 +326,44 @@ void schedulerDestroy(scheduler_t* scheduler)
 // Called at a job arrival to schedule the job
 void schedulerScheduleJob(scheduler_t* scheduler, job_t* job)
 {
+    schedulerScheduleJobWith(scheduler, scheduler->scheduleJob, job);
+}
+
+// Called at the arrival of jobs with the same arrival time to schedule them
+// Schedulers without a batch function get the jobs one at a time
+void schedulerScheduleJobBatch(scheduler_t* scheduler, job_t** jobs, size_t numJobs)
+{
+    if (scheduler->scheduleJobBatch == NULL) {
+        for (size_t i = 0; i < numJobs; i++) {
+            schedulerScheduleJob(scheduler, jobs[i]);
+        }
+        return;
+    }
+    schedulerSampleArrivals(scheduler, numJobs);
     uint64_t currentTime = simulatorSimTime(scheduler->sim);
-    scheduler->scheduleJob(scheduler->schedulerInfo, scheduler, job, currentTime);
+    schedulerCountersStart(scheduler);
+    scheduler->scheduleJobBatch(scheduler->schedulerInfo, scheduler, jobs, numJobs, currentTime);
+    schedulerCountersStop(scheduler);
+    schedulerRemoveCancelledCompletion(scheduler);
 }
 
 // Called at a job completion
 void schedulerCompleteJob(void* s)
 {
     scheduler_t* scheduler = (scheduler_t*)s;
-    scheduler->completionEvent = NULL;
-    uint64_t currentTime = simulatorSimTime(scheduler->sim);
-    job_t* job = scheduler->completeJob(scheduler->schedulerInfo, scheduler, currentTime);
-    if (job) {
-        scheduler->completionCallback(scheduler->completionCallbackData, job);
-    }
+    schedulerCompleteJobWith(scheduler, scheduler->completeJob);
 }
 
 // Schedule next completion at given time
 // Returns true on success, false otherwise
 bool schedulerScheduleNextCompletion(scheduler_t* scheduler, uint64_t timestamp)
 {
+    // A completion cancelled during the same scheduler call is moved instead
+    if (scheduler->completionCancelled) {
+        scheduler->completionCancelled = false;
+        simulatorRescheduleEvent(scheduler->sim, scheduler->completionEvent, timestamp);
+        return true;
+    }
     // Check if completion already scheduled
     if (scheduler->completionEvent) {
         return false;
@@ -95,14 +377,90 @@ bool schedulerScheduleNextCompletion(scheduler_t* scheduler, uint64_t timestamp)
 }
 
 // Cancel next completion event
+// The event stays in the event queue until the scheduler call returns, so that
+// scheduling the next completion in the same call can move it in place
 // Returns true on success, false otherwise
 bool schedulerCancelNextCompletion(scheduler_t* scheduler)
 {
     // Check if there isn't an existing completion to cancel
-    if (scheduler->completionEvent == NULL) {
+    if (scheduler->completionEvent == NULL || scheduler->completionCancelled) {
         return false;
     }
-    simulatorRemoveEvent(scheduler->sim, scheduler->completionEvent);
-    scheduler->completionEvent = NULL;
+    scheduler->completionCancelled = true;
+    return true;
+}
+
+// Move the next completion to the given time, or schedule it if there is none
+// The existing completion event is updated in place
+// Returns true on success, false otherwise
+bool schedulerRescheduleNextCompletion(scheduler_t* scheduler, uint64_t timestamp)
+{
+    if (scheduler->completionEvent == NULL || scheduler->completionCancelled) {
+        return schedulerScheduleNextCompletion(scheduler, timestamp);
+    }
+    simulatorRescheduleEvent(scheduler->sim, scheduler->completionEvent, timestamp);
     return true;
 }
+
+// Get the time of the next completion event
+// Returns true if a completion is scheduled, false otherwise
+bool schedulerNextCompletionTime(scheduler_t* scheduler, uint64_t* timestamp)
+{
+    if (scheduler->completionEvent == NULL || scheduler->completionCancelled) {
+        return false;
+    }
+    *timestamp = ((event_t*)list_data(scheduler->completionEvent))->timestamp;
+    return true;
+}
+
+// Creates an occupancy sampler
+// numQueues - number of queues the sampler is attached to, for the utilization
+// series - file for the per-interval averages, or NULL for none
+// interval - length of a series interval
+// Returns the sampler or NULL on failure
+scheduler_sampler_t* schedulerSamplerCreate(size_t numQueues, FILE* series, uint64_t interval)
+{
+    scheduler_sampler_t* sampler = calloc(1, sizeof(scheduler_sampler_t));
+    if (sampler == NULL) {
+        return NULL;
+    }
+    sampler->numQueues = numQueues;
+    sampler->series = series;
+    sampler->interval = interval;
+    return sampler;
+}
+
+// Writes a series row with the averages since the start of the current interval
+static void schedulerSamplerWriteRow(scheduler_sampler_t* sampler, uint64_t intervalStart, uint64_t length)
+{
+    double jobs = (double)(sampler->jobArea - sampler->intervalJobArea) / (double)length;
+    double busy = (double)(sampler->busyArea - sampler->intervalBusyArea) / (double)length / (double)sampler->numQueues;
+    fprintf(sampler->series, "%" PRIu64 ",%.6f,%.6f\n", intervalStart, jobs, busy);
+    sampler->intervalJobArea = sampler->jobArea;
+    sampler->intervalBusyArea = sampler->busyArea;
+}
+
+// Writes the series intervals that end at or before a time
+// Called by schedulerSamplerAdvance
+void schedulerSamplerWriteIntervals(scheduler_sampler_t* sampler, uint64_t currentTime)
+{
+    while (currentTime >= sampler->intervalEnd) {
+        uint64_t elapsed = sampler->intervalEnd - sampler->lastTime;
+        sampler->jobArea += (unsigned __int128)sampler->numJobs * elapsed;
+        sampler->busyArea += (unsigned __int128)sampler->numBusy * elapsed;
+        sampler->lastTime = sampler->intervalEnd;
+        schedulerSamplerWriteRow(sampler, sampler->intervalEnd - sampler->interval, sampler->interval);
+        sampler->intervalEnd += sampler->interval;
+    }
+}
+
+// Writes the last, partial series interval and destroys a sampler
+// The series file is not closed
+void schedulerSamplerDestroy(scheduler_sampler_t* sampler)
+{
+    uint64_t intervalStart = sampler->intervalEnd - sampler->interval;
+    if (sampler->series && sampler->started && sampler->lastTime > intervalStart) {
+        schedulerSamplerWriteRow(sampler, intervalStart, sampler->lastTime - intervalStart);
+    }
+    free(sampler);
+}
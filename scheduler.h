@@ -3,9 +3,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "simulator.h"
 #include "job.h"
 #include "linked_list.h"
+#include "perfCounters.h"
 
 typedef struct scheduler scheduler_t;
 
@@ -13,12 +15,24 @@ typedef struct scheduler scheduler_t;
 typedef void* (*scheduler_info_create_fn)();
 // Destroys scheduler specific info
 typedef void (*scheduler_info_destroy_fn)(void* schedulerInfo);
+// Configures scheduler specific info from the parameters in "name:params"
+// schedulerInfo - scheduler specific info from create function
+// params - parameters after the colon
+// Returns true on success, false otherwise
+typedef bool (*scheduler_configure_fn)(void* schedulerInfo, const char* params);
 // Called to schedule a new job in the queue
 // schedulerInfo - scheduler specific info from create function
 // scheduler - used to call schedulerScheduleNextCompletion and schedulerCancelNextCompletion
 // job - new job being added to the queue
 // currentTime - the current simulated time
 typedef void (*schedule_job_fn)(void* schedulerInfo, scheduler_t* scheduler, job_t* job, uint64_t currentTime);
+// Called to schedule new jobs that arrive at the same time (optional)
+// schedulerInfo - scheduler specific info from create function
+// scheduler - used to call schedulerScheduleNextCompletion and schedulerCancelNextCompletion
+// jobs - new jobs being added to the queue in arrival order
+// numJobs - number of new jobs
+// currentTime - the current simulated time
+typedef void (*schedule_job_batch_fn)(void* schedulerInfo, scheduler_t* scheduler, job_t** jobs, size_t numJobs, uint64_t currentTime);
 // Called to complete a job in response to an earlier call to schedulerScheduleNextCompletion
 // schedulerInfo - scheduler specific info from create function
 // scheduler - used to call schedulerScheduleNextCompletion and schedulerCancelNextCompletion
@@ -31,20 +45,129 @@ typedef job_t* (*complete_job_fn)(void* schedulerInfo, scheduler_t* scheduler, u
 // job - job that is being completed
 typedef void (*completionCallback_fn)(void* completionCallbackData, job_t* job);
 
+// Time-weighted occupancy of the queues it is attached to
+// Every arrival and completion adds the number of jobs in system and the number of
+// busy queues times the time since the previous event to their integrals, so the
+// time averages cost O(1) per event and nothing per job. With a series file, the
+// averages over every interval [k * interval, (k + 1) * interval) are also written
+// as they complete, for plotting long runs.
+typedef struct {
+    size_t numQueues; // number of queues the sampler is attached to
+    uint64_t numJobs; // jobs in the queues
+    uint64_t numBusy; // queues with jobs
+    uint64_t maxJobs; // most jobs in the queues at once
+    bool started; // the first arrival was sampled
+    uint64_t startTime; // time of the first arrival
+    uint64_t lastTime; // time of the last event
+    unsigned __int128 jobArea; // integral of numJobs over time
+    unsigned __int128 busyArea; // integral of numBusy over time
+    FILE* series; // per-interval averages (NULL for none)
+    uint64_t interval; // length of a series interval
+    uint64_t intervalEnd; // end of the current series interval
+    unsigned __int128 intervalJobArea; // jobArea at the start of the current series interval
+    unsigned __int128 intervalBusyArea; // busyArea at the start of the current series interval
+} scheduler_sampler_t;
+
 typedef struct scheduler {
     scheduler_info_create_fn create; // scheduler specific create function
     scheduler_info_destroy_fn destroy; // scheduler specific destroy function
+    scheduler_configure_fn configure; // scheduler specific configure function (NULL if it takes no parameters)
     schedule_job_fn scheduleJob; // scheduler specific schedule function
+    schedule_job_batch_fn scheduleJobBatch; // scheduler specific batch schedule function (NULL if not implemented)
     complete_job_fn completeJob; // scheduler specific complete function
     void* schedulerInfo; // scheduler specific info
     simulator_t* sim; // simulator
     completionCallback_fn completionCallback; // function to call upon job completion
     void* completionCallbackData; // data to pass to callback function
     list_node_t* completionEvent; // completion event reference
+    bool completionCancelled; // completion event cancelled but kept in the event queue until the scheduler returns
+    scheduler_sampler_t* sampler; // occupancy sampler (NULL when not sampled)
+    uint64_t numJobs; // jobs at the queue, counted while sampled
+    perf_counters_t* counters; // counters running only inside the policy's functions (NULL when not counted)
 } scheduler_t;
 
+// Starts the counters of a scheduler before a call into its policy
+static inline void schedulerCountersStart(scheduler_t* scheduler)
+{
+    if (scheduler->counters) {
+        perfCountersStart(scheduler->counters);
+    }
+}
+
+// Stops the counters of a scheduler after a call into its policy
+static inline void schedulerCountersStop(scheduler_t* scheduler)
+{
+    if (scheduler->counters) {
+        perfCountersStop(scheduler->counters);
+    }
+}
+
+// Creates an occupancy sampler
+// numQueues - number of queues the sampler is attached to, for the utilization
+// series - file for the per-interval averages, or NULL for none
+// interval - length of a series interval
+// Returns the sampler or NULL on failure
+scheduler_sampler_t* schedulerSamplerCreate(size_t numQueues, FILE* series, uint64_t interval);
+
+// Writes the last, partial series interval and destroys a sampler
+// The series file is not closed
+void schedulerSamplerDestroy(scheduler_sampler_t* sampler);
+
+// Writes the series intervals that end at or before a time
+// Called by schedulerSamplerAdvance
+void schedulerSamplerWriteIntervals(scheduler_sampler_t* sampler, uint64_t currentTime);
+
+// Adds the occupancy since the last event to a sampler's integrals
+static inline void schedulerSamplerAdvance(scheduler_sampler_t* sampler, uint64_t currentTime)
+{
+    if (!sampler->started) {
+        sampler->started = true;
+        sampler->startTime = currentTime;
+        sampler->lastTime = currentTime;
+        if (sampler->series) {
+            sampler->intervalEnd = (currentTime / sampler->interval + 1) * sampler->interval;
+        }
+    }
+    if (sampler->series && currentTime >= sampler->intervalEnd) {
+        schedulerSamplerWriteIntervals(sampler, currentTime);
+    }
+    uint64_t elapsed = currentTime - sampler->lastTime;
+    sampler->jobArea += (unsigned __int128)sampler->numJobs * elapsed;
+    sampler->busyArea += (unsigned __int128)sampler->numBusy * elapsed;
+    sampler->lastTime = currentTime;
+}
+
+// Samples jobs arriving at a queue at the current time
+static inline void schedulerSampleArrivals(scheduler_t* scheduler, size_t numJobs)
+{
+    scheduler_sampler_t* sampler = scheduler->sampler;
+    if (sampler == NULL) {
+        return;
+    }
+    schedulerSamplerAdvance(sampler, simulatorSimTime(scheduler->sim));
+    sampler->numBusy += scheduler->numJobs == 0;
+    scheduler->numJobs += numJobs;
+    sampler->numJobs += numJobs;
+    if (sampler->numJobs > sampler->maxJobs) {
+        sampler->maxJobs = sampler->numJobs;
+    }
+}
+
+// Samples a job completing at a queue at the current time
+static inline void schedulerSampleCompletion(scheduler_t* scheduler)
+{
+    scheduler_sampler_t* sampler = scheduler->sampler;
+    if (sampler == NULL) {
+        return;
+    }
+    schedulerSamplerAdvance(sampler, simulatorSimTime(scheduler->sim));
+    scheduler->numJobs--;
+    sampler->numJobs--;
+    sampler->numBusy -= scheduler->numJobs == 0;
+}
+
 // Creates a scheduler
-// schedulerName - name of scheduler
+// schedulerName - name of scheduler, optionally followed by ":params" (e.g. "RR:8")
 // sim - simulator
 // completionCallback - function to call upon job completion
 // completionCallbackData - data to pass to completionCallback
@@ -54,9 +177,54 @@ scheduler_t* schedulerCreate(const char* schedulerName, simulator_t* sim, comple
 // Destroys a scheduler
 void schedulerDestroy(scheduler_t* scheduler);
 
+// Removes a completion event that was cancelled and not scheduled again
+// Called once a scheduler specific function returns
+static inline void schedulerRemoveCancelledCompletion(scheduler_t* scheduler)
+{
+    if (scheduler->completionCancelled) {
+        simulatorRemoveEvent(scheduler->sim, scheduler->completionEvent);
+        scheduler->completionEvent = NULL;
+        scheduler->completionCancelled = false;
+    }
+}
+
+// Schedules an arriving job with the given schedule function
+// schedulerScheduleJob passes the scheduler's own function; a caller that passes a
+// policy's function by name calls it directly, so the compiler can inline it
+static inline void schedulerScheduleJobWith(scheduler_t* scheduler, schedule_job_fn scheduleJob, job_t* job)
+{
+    schedulerSampleArrivals(scheduler, 1);
+    uint64_t currentTime = simulatorSimTime(scheduler->sim);
+    schedulerCountersStart(scheduler);
+    scheduleJob(scheduler->schedulerInfo, scheduler, job, currentTime);
+    schedulerCountersStop(scheduler);
+    schedulerRemoveCancelledCompletion(scheduler);
+}
+
+// Completes a job with the given complete function
+// schedulerCompleteJob passes the scheduler's own function; a caller that passes a
+// policy's function by name calls it directly, so the compiler can inline it
+static inline void schedulerCompleteJobWith(scheduler_t* scheduler, complete_job_fn completeJob)
+{
+    scheduler->completionEvent = NULL;
+    uint64_t currentTime = simulatorSimTime(scheduler->sim);
+    schedulerCountersStart(scheduler);
+    job_t* job = completeJob(scheduler->schedulerInfo, scheduler, currentTime);
+    schedulerCountersStop(scheduler);
+    schedulerRemoveCancelledCompletion(scheduler);
+    if (job) {
+        schedulerSampleCompletion(scheduler);
+        scheduler->completionCallback(scheduler->completionCallbackData, job);
+    }
+}
+
 // Called at a job arrival to schedule the job
 void schedulerScheduleJob(scheduler_t* scheduler, job_t* job);
 
+// Called at the arrival of jobs with the same arrival time to schedule them
+// Schedulers without a batch function get the jobs one at a time
+void schedulerScheduleJobBatch(scheduler_t* scheduler, job_t** jobs, size_t numJobs);
+
 // Called at a job completion
 void schedulerCompleteJob(void* s);
 
@@ -65,9 +233,20 @@ void schedulerCompleteJob(void* s);
 bool schedulerScheduleNextCompletion(scheduler_t* scheduler, uint64_t timestamp);
 
 // Cancel next completion event
+// The event stays in the event queue until the scheduler call returns, so that
+// scheduling the next completion in the same call can move it in place
 // Returns true on success, false otherwise
 bool schedulerCancelNextCompletion(scheduler_t* scheduler);
 
+// Move the next completion to the given time, or schedule it if there is none
+// The existing completion event is updated in place
+// Returns true on success, false otherwise
+bool schedulerRescheduleNextCompletion(scheduler_t* scheduler, uint64_t timestamp);
+
+// Get the time of the next completion event
+// Returns true if a completion is scheduled, false otherwise
+bool schedulerNextCompletionTime(scheduler_t* scheduler, uint64_t* timestamp);
+
 // Defines scheduler specific functions
 #define DEFINE_SCHEDULER(schedulerName)                                 \
     void* scheduler ## schedulerName ## Create();                       \
@@ -75,13 +254,120 @@ bool schedulerCancelNextCompletion(scheduler_t* scheduler);
     void scheduler ## schedulerName ## ScheduleJob(void* schedulerInfo, scheduler_t* scheduler, job_t* job, uint64_t currentTime); \
     job_t* scheduler ## schedulerName ## CompleteJob(void* schedulerInfo, scheduler_t* scheduler, uint64_t currentTime);
 
-// Initializes scheduler specific functions
-#define INIT_SCHEDULER(s, schedulerName) do {                           \
-        (s)->create = scheduler ## schedulerName ## Create;             \
-        (s)->destroy = scheduler ## schedulerName ## Destroy;           \
-        (s)->scheduleJob = scheduler ## schedulerName ## ScheduleJob;   \
-        (s)->completeJob = scheduler ## schedulerName ## CompleteJob;   \
-    } while (0)
+// Defines the configure function of a scheduler that takes parameters
+#define DEFINE_SCHEDULER_CONFIGURE(schedulerName)                       \
+    bool scheduler ## schedulerName ## Configure(void* schedulerInfo, const char* params);
+
+// Defines the batch schedule function of a scheduler that takes all arrivals at one time at once
+#define DEFINE_SCHEDULER_BATCH(schedulerName)                           \
+    void scheduler ## schedulerName ## ScheduleJobBatch(void* schedulerInfo, scheduler_t* scheduler, job_t** jobs, size_t numJobs, uint64_t currentTime);
+
+// Scheduler capability flags
+#define SCHEDULER_PREEMPTIVE 0x1 // may interrupt a running job
+#define SCHEDULER_SIZE_AWARE 0x2 // uses job sizes to order jobs
+
+// Scheduling policy descriptor
+typedef struct {
+    const char* name; // name used to select the policy
+    const char* description; // one line description for the usage info
+    unsigned flags; // capability flags
+    scheduler_info_create_fn create; // scheduler specific create function
+    scheduler_info_destroy_fn destroy; // scheduler specific destroy function
+    schedule_job_fn scheduleJob; // scheduler specific schedule function
+    complete_job_fn completeJob; // scheduler specific complete function
+    scheduler_configure_fn configure; // scheduler specific configure function (NULL if it takes no parameters)
+    schedule_job_batch_fn scheduleJobBatch; // scheduler specific batch schedule function (NULL if not implemented)
+} scheduler_descriptor_t;
+
+// Initializer for the descriptor of a scheduler defined with DEFINE_SCHEDULER
+#define SCHEDULER_DESCRIPTOR(schedulerName, schedulerFlags, schedulerDescription) { \
+        #schedulerName, schedulerDescription, schedulerFlags,           \
+        scheduler ## schedulerName ## Create,                           \
+        scheduler ## schedulerName ## Destroy,                          \
+        scheduler ## schedulerName ## ScheduleJob,                      \
+        scheduler ## schedulerName ## CompleteJob,                      \
+        NULL,                                                           \
+        NULL                                                            \
+    }
+
+// Initializer for the descriptor of a scheduler that also has DEFINE_SCHEDULER_CONFIGURE
+#define SCHEDULER_DESCRIPTOR_CONFIGURE(schedulerName, schedulerFlags, schedulerDescription) { \
+        #schedulerName, schedulerDescription, schedulerFlags,           \
+        scheduler ## schedulerName ## Create,                           \
+        scheduler ## schedulerName ## Destroy,                          \
+        scheduler ## schedulerName ## ScheduleJob,                      \
+        scheduler ## schedulerName ## CompleteJob,                      \
+        scheduler ## schedulerName ## Configure,                        \
+        NULL                                                            \
+    }
+
+// Initializer for the descriptor of a scheduler that also has DEFINE_SCHEDULER_CONFIGURE
+// and DEFINE_SCHEDULER_BATCH
+#define SCHEDULER_DESCRIPTOR_CONFIGURE_BATCH(schedulerName, schedulerFlags, schedulerDescription) { \
+        #schedulerName, schedulerDescription, schedulerFlags,           \
+        scheduler ## schedulerName ## Create,                           \
+        scheduler ## schedulerName ## Destroy,                          \
+        scheduler ## schedulerName ## ScheduleJob,                      \
+        scheduler ## schedulerName ## CompleteJob,                      \
+        scheduler ## schedulerName ## Configure,                        \
+        scheduler ## schedulerName ## ScheduleJobBatch                  \
+    }
+
+// Function a scheduler plugin exports under SCHEDULER_PLUGIN_INIT to register its policies
+// Returns true on success, false otherwise
+typedef bool (*scheduler_plugin_init_fn)(void);
+#define SCHEDULER_PLUGIN_INIT "schedulerPluginInit"
+
+// Registers a scheduling policy
+// Registration must not run concurrently with other registry functions
+// descriptor - policy descriptor, must stay valid while the policy is registered
+// Returns true on success, false if the name is taken or on failure
+bool schedulerRegister(const scheduler_descriptor_t* descriptor);
+
+// Creates a scheduler around scheduler specific info that was already created
+// descriptor - policy descriptor, its create function is not called
+// schedulerInfo - scheduler specific info, destroyed on failure
+// sim - simulator
+// completionCallback - function to call upon job completion
+// completionCallbackData - data to pass to completionCallback
+// Returns scheduler on success or NULL otherwise
+scheduler_t* schedulerCreateWithInfo(const scheduler_descriptor_t* descriptor, void* schedulerInfo, simulator_t* sim,
+                                     completionCallback_fn completionCallback, void* completionCallbackData);
+
+// Finds a registered scheduling policy in O(1)
+// schedulerName - name of scheduler, optionally followed by ":params"
+// Returns the descriptor or NULL if there is no such policy
+const scheduler_descriptor_t* schedulerFind(const char* schedulerName);
+
+// Returns the number of registered scheduling policies
+size_t schedulerCount(void);
+
+// Returns the registered scheduling policy at the given index in registration order
+const scheduler_descriptor_t* schedulerGet(size_t index);
+
+// Returns true if a policy is built in rather than registered by a plugin
+bool schedulerIsBuiltin(const scheduler_descriptor_t* descriptor);
+
+// Loads a shared object and calls its SCHEDULER_PLUGIN_INIT function
+// Returns true on success, false otherwise
+bool schedulerLoadPlugin(const char* path);
+
+// Unloads all plugins and unregisters their policies
+void schedulerUnloadPlugins(void);
+
+// Returns true if a policy can run on a queue that spills to disk
+bool schedulerSpillSupported(const char* schedulerName);
+
+// Creates an FCFS or LCFS scheduler whose waiting jobs spill to disk
+// schedulerName - FCFS or LCFS
+// spillDir - directory for the spilled jobs
+// memoryJobs - waiting jobs kept in memory
+// sim - simulator
+// completionCallback - function to call upon job completion
+// completionCallbackData - data to pass to completionCallback
+// Returns scheduler on success or NULL otherwise
+scheduler_t* schedulerSpillCreate(const char* schedulerName, const char* spillDir, size_t memoryJobs, simulator_t* sim,
+                                  completionCallback_fn completionCallback, void* completionCallbackData);
 
 DEFINE_SCHEDULER(FCFS)
 DEFINE_SCHEDULER(LCFS)
@@ -91,5 +377,11 @@ DEFINE_SCHEDULER(PSJF)
 DEFINE_SCHEDULER(SRPT)
 DEFINE_SCHEDULER(PS)
 DEFINE_SCHEDULER(FB)
+DEFINE_SCHEDULER(RR)
+DEFINE_SCHEDULER_CONFIGURE(RR)
+DEFINE_SCHEDULER_BATCH(RR)
+DEFINE_SCHEDULER(MLFQ)
+DEFINE_SCHEDULER_CONFIGURE(MLFQ)
+DEFINE_SCHEDULER_BATCH(MLFQ)
 
 #endif /* SCHEDULER_H */
@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "scheduler.h"
+#include "job.h"
+#include "linked_list.h"
+
+// Multi-level feedback queue
+// Every level is a round robin queue with its own quantum. New jobs enter the top
+// level, a job that uses up its quantum moves to the back of the next level, and
+// the bottom level keeps its jobs. The front job of the highest non-empty level
+// runs; a job preempted by an arrival at a higher level stays at the front of its
+// level and keeps the unused part of its quantum.
+// While only one job is runnable its quanta are coalesced into a single event at
+// its completion, and its level and position within the current quantum are
+// recovered from the elapsed time once another job arrives.
+
+#define SCHEDULER_MLFQ_MAX_LEVELS 16
+
+static const uint64_t SCHEDULER_MLFQ_DEFAULT_QUANTA[] = {2, 4, 8, 16};
+
+// Job with its level
+typedef struct {
+    job_t* job; // job
+    size_t level; // current level
+    uint64_t used; // time used of the current quantum
+} scheduler_MLFQ_job_t;
+
+typedef struct {
+    list_t* levels[SCHEDULER_MLFQ_MAX_LEVELS]; // run queues, new jobs are inserted at the head and the tail runs
+    uint64_t quanta[SCHEDULER_MLFQ_MAX_LEVELS]; // time slice length per level
+    size_t numLevels; // number of levels
+    size_t numJobs; // number of jobs at all levels
+    scheduler_MLFQ_job_t* running; // running job
+    uint64_t lastUpdate; // time the running job was last charged
+} scheduler_MLFQ_t;
+
+// Creates and returns scheduler specific info
+void* schedulerMLFQCreate()
+{
+    scheduler_MLFQ_t* info = malloc(sizeof(scheduler_MLFQ_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < SCHEDULER_MLFQ_MAX_LEVELS; i++) {
+        info->levels[i] = list_create(NULL);
+        if (info->levels[i] == NULL) {
+            for (size_t j = 0; j < i; j++) {
+                list_destroy(info->levels[j]);
+            }
+            free(info);
+            return NULL;
+        }
+    }
+    info->numLevels = sizeof(SCHEDULER_MLFQ_DEFAULT_QUANTA) / sizeof(SCHEDULER_MLFQ_DEFAULT_QUANTA[0]);
+    memcpy(info->quanta, SCHEDULER_MLFQ_DEFAULT_QUANTA, sizeof(SCHEDULER_MLFQ_DEFAULT_QUANTA));
+    info->numJobs = 0;
+    info->running = NULL;
+    info->lastUpdate = 0;
+    return info;
+}
+
+// Destroys scheduler specific info
+void schedulerMLFQDestroy(void* schedulerInfo)
+{
+    scheduler_MLFQ_t* info = (scheduler_MLFQ_t*)schedulerInfo;
+    for (size_t i = 0; i < SCHEDULER_MLFQ_MAX_LEVELS; i++) {
+        for (list_node_t* node = list_head(info->levels[i]); node != list_end(info->levels[i]); node = list_next(node)) {
+            free(list_data(node));
+        }
+        list_destroy(info->levels[i]);
+    }
+    free(info);
+}
+
+// Configures the levels from "MLFQ:q0,q1,..." with the quantum of every level
+// Returns true on success, false otherwise
+bool schedulerMLFQConfigure(void* schedulerInfo, const char* params)
+{
+    scheduler_MLFQ_t* info = (scheduler_MLFQ_t*)schedulerInfo;
+    size_t numLevels = 0;
+    for (;;) {
+        char* end;
+        if (numLevels == SCHEDULER_MLFQ_MAX_LEVELS || *params < '0' || *params > '9') {
+            return false;
+        }
+        info->quanta[numLevels] = strtoull(params, &end, 10);
+        if (info->quanta[numLevels++] == 0) {
+            return false;
+        }
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            return false;
+        }
+        params = end + 1;
+    }
+    info->numLevels = numLevels;
+    return true;
+}
+
+// Returns the front job of the highest non-empty level or NULL if there is none
+static scheduler_MLFQ_job_t* schedulerMLFQFront(scheduler_MLFQ_t* info)
+{
+    for (size_t i = 0; i < info->numLevels; i++) {
+        if (list_count(info->levels[i]) > 0) {
+            return list_data(list_tail(info->levels[i]));
+        }
+    }
+    return NULL;
+}
+
+// Moves a job at the front of its level to the back of the given level
+static void schedulerMLFQRequeue(scheduler_MLFQ_t* info, scheduler_MLFQ_job_t* mlfqJob, size_t level)
+{
+    list_remove(info->levels[mlfqJob->level], list_tail(info->levels[mlfqJob->level]));
+    mlfqJob->level = level;
+    mlfqJob->used = 0;
+    list_insert(info->levels[level], mlfqJob);
+}
+
+// Charges the running job for the time since the last update
+static void schedulerMLFQCharge(scheduler_MLFQ_t* info, uint64_t currentTime)
+{
+    scheduler_MLFQ_job_t* running = info->running;
+    if (running == NULL) {
+        return;
+    }
+    uint64_t elapsed = currentTime - info->lastUpdate;
+    jobSetRemainingTime(running->job, jobGetRemainingTime(running->job) - elapsed);
+    info->lastUpdate = currentTime;
+    if (info->numJobs > 1) {
+        running->used += elapsed;
+        return;
+    }
+    // Coalesced quanta, a lone job sinks one level per expired quantum
+    size_t level = running->level;
+    uint64_t used = running->used;
+    while (level + 1 < info->numLevels && elapsed >= info->quanta[level] - used) {
+        elapsed -= info->quanta[level] - used;
+        used = 0;
+        level++;
+    }
+    used = (used + elapsed) % info->quanta[level];
+    if (level != running->level) {
+        schedulerMLFQRequeue(info, running, level);
+    }
+    running->used = used;
+}
+
+// Picks the running job and schedules the end of its slice
+static void schedulerMLFQScheduleSlice(scheduler_MLFQ_t* info, scheduler_t* scheduler, uint64_t currentTime)
+{
+    info->running = schedulerMLFQFront(info);
+    info->lastUpdate = currentTime;
+    if (info->running == NULL) {
+        schedulerCancelNextCompletion(scheduler);
+        return;
+    }
+    uint64_t slice = jobGetRemainingTime(info->running->job);
+    uint64_t left = info->quanta[info->running->level] - info->running->used;
+    if (info->numJobs > 1 && left < slice) {
+        slice = left;
+    }
+    schedulerRescheduleNextCompletion(scheduler, currentTime + slice);
+}
+
+// Called to schedule a new job in the queue
+void schedulerMLFQScheduleJob(void* schedulerInfo, scheduler_t* scheduler, job_t* job, uint64_t currentTime)
+{
+    scheduler_MLFQ_t* info = (scheduler_MLFQ_t*)schedulerInfo;
+    scheduler_MLFQ_job_t* mlfqJob = malloc(sizeof(scheduler_MLFQ_job_t));
+    if (mlfqJob == NULL) {
+        printf("Out of memory in MLFQ scheduler\n");
+        exit(-1);
+    }
+    schedulerMLFQCharge(info, currentTime);
+    mlfqJob->job = job;
+    mlfqJob->level = 0;
+    mlfqJob->used = 0;
+    list_insert(info->levels[0], mlfqJob);
+    info->numJobs++;
+    // The new job may preempt the running job or end its coalesced quanta
+    schedulerMLFQScheduleSlice(info, scheduler, currentTime);
+}
+
+// Called to schedule new jobs that arrive at the same time
+void schedulerMLFQScheduleJobBatch(void* schedulerInfo, scheduler_t* scheduler, job_t** jobs, size_t numJobs, uint64_t currentTime)
+{
+    scheduler_MLFQ_t* info = (scheduler_MLFQ_t*)schedulerInfo;
+    schedulerMLFQCharge(info, currentTime);
+    for (size_t i = 0; i < numJobs; i++) {
+        scheduler_MLFQ_job_t* mlfqJob = malloc(sizeof(scheduler_MLFQ_job_t));
+        if (mlfqJob == NULL) {
+            printf("Out of memory in MLFQ scheduler\n");
+            exit(-1);
+        }
+        mlfqJob->job = jobs[i];
+        mlfqJob->level = 0;
+        mlfqJob->used = 0;
+        list_insert(info->levels[0], mlfqJob);
+    }
+    info->numJobs += numJobs;
+    schedulerMLFQScheduleSlice(info, scheduler, currentTime);
+}
+
+// Called to complete a job in response to an earlier call to schedulerScheduleNextCompletion
+// Returns NULL when the running job's quantum expired
+job_t* schedulerMLFQCompleteJob(void* schedulerInfo, scheduler_t* scheduler, uint64_t currentTime)
+{
+    scheduler_MLFQ_t* info = (scheduler_MLFQ_t*)schedulerInfo;
+    scheduler_MLFQ_job_t* running = info->running;
+    schedulerMLFQCharge(info, currentTime);
+    job_t* job = NULL;
+    if (jobGetRemainingTime(running->job) == 0) {
+        job = running->job;
+        list_remove(info->levels[running->level], list_tail(info->levels[running->level]));
+        info->numJobs--;
+        free(running);
+    } else {
+        // Quantum expired, move to the back of the next level
+        size_t level = running->level + 1 < info->numLevels ? running->level + 1 : running->level;
+        schedulerMLFQRequeue(info, running, level);
+    }
+    schedulerMLFQScheduleSlice(info, scheduler, currentTime);
+    return job;
+}
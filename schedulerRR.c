@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "scheduler.h"
+#include "job.h"
+#include "linked_list.h"
+
+// Round robin with a fixed quantum
+// Jobs wait in a FIFO run queue and the job at the front runs for up to one quantum
+// before it moves to the back. A job whose quantum expires at the same time as an
+// arrival moves to the back first, since completion events go before arrivals.
+// While only one job is runnable its quanta are coalesced into a single event at
+// its completion, and the position within the current quantum is recovered from
+// the elapsed time once another job arrives.
+
+#define SCHEDULER_RR_DEFAULT_QUANTUM 4
+
+typedef struct {
+    list_t* queue; // run queue, new jobs are inserted at the head and the tail runs
+    uint64_t quantum; // time slice length
+    uint64_t used; // time the running job used of its current quantum
+    uint64_t lastUpdate; // time the running job was last charged
+} scheduler_RR_t;
+
+// Creates and returns scheduler specific info
+void* schedulerRRCreate()
+{
+    scheduler_RR_t* info = malloc(sizeof(scheduler_RR_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    info->queue = list_create(NULL);
+    if (info->queue == NULL) {
+        free(info);
+        return NULL;
+    }
+    info->quantum = SCHEDULER_RR_DEFAULT_QUANTUM;
+    info->used = 0;
+    info->lastUpdate = 0;
+    return info;
+}
+
+// Destroys scheduler specific info
+void schedulerRRDestroy(void* schedulerInfo)
+{
+    scheduler_RR_t* info = (scheduler_RR_t*)schedulerInfo;
+    list_destroy(info->queue);
+    free(info);
+}
+
+// Configures the quantum from "RR:quantum"
+// Returns true on success, false otherwise
+bool schedulerRRConfigure(void* schedulerInfo, const char* params)
+{
+    scheduler_RR_t* info = (scheduler_RR_t*)schedulerInfo;
+    char* end;
+    if (*params < '0' || *params > '9') {
+        return false;
+    }
+    info->quantum = strtoull(params, &end, 10);
+    return *end == '\0' && info->quantum > 0;
+}
+
+// Charges the running job for the time since the last update
+static void schedulerRRCharge(scheduler_RR_t* info, uint64_t currentTime)
+{
+    if (list_count(info->queue) == 0) {
+        return;
+    }
+    job_t* job = list_data(list_tail(info->queue));
+    uint64_t elapsed = currentTime - info->lastUpdate;
+    jobSetRemainingTime(job, jobGetRemainingTime(job) - elapsed);
+    if (list_count(info->queue) == 1) {
+        // Coalesced quanta, a lone job moves to the back of its own queue
+        info->used = (info->used + elapsed) % info->quantum;
+    } else {
+        info->used += elapsed;
+    }
+    info->lastUpdate = currentTime;
+}
+
+// Schedules the end of the running job's slice
+static void schedulerRRScheduleSlice(scheduler_RR_t* info, scheduler_t* scheduler, uint64_t currentTime)
+{
+    if (list_count(info->queue) == 0) {
+        schedulerCancelNextCompletion(scheduler);
+        return;
+    }
+    job_t* job = list_data(list_tail(info->queue));
+    uint64_t slice = jobGetRemainingTime(job);
+    if (list_count(info->queue) > 1 && info->quantum - info->used < slice) {
+        slice = info->quantum - info->used;
+    }
+    schedulerRescheduleNextCompletion(scheduler, currentTime + slice);
+}
+
+// Called to schedule a new job in the queue
+void schedulerRRScheduleJob(void* schedulerInfo, scheduler_t* scheduler, job_t* job, uint64_t currentTime)
+{
+    scheduler_RR_t* info = (scheduler_RR_t*)schedulerInfo;
+    if (list_count(info->queue) == 0) {
+        info->used = 0;
+        info->lastUpdate = currentTime;
+    } else {
+        schedulerRRCharge(info, currentTime);
+    }
+    list_insert(info->queue, job);
+    // The running job may no longer be alone, so its slice may end earlier
+    schedulerRRScheduleSlice(info, scheduler, currentTime);
+}
+
+// Called to schedule new jobs that arrive at the same time
+void schedulerRRScheduleJobBatch(void* schedulerInfo, scheduler_t* scheduler, job_t** jobs, size_t numJobs, uint64_t currentTime)
+{
+    scheduler_RR_t* info = (scheduler_RR_t*)schedulerInfo;
+    if (list_count(info->queue) == 0) {
+        info->used = 0;
+        info->lastUpdate = currentTime;
+    } else {
+        schedulerRRCharge(info, currentTime);
+    }
+    for (size_t i = 0; i < numJobs; i++) {
+        list_insert(info->queue, jobs[i]);
+    }
+    schedulerRRScheduleSlice(info, scheduler, currentTime);
+}
+
+// Called to complete a job in response to an earlier call to schedulerScheduleNextCompletion
+// Returns NULL when the running job's quantum expired
+job_t* schedulerRRCompleteJob(void* schedulerInfo, scheduler_t* scheduler, uint64_t currentTime)
+{
+    scheduler_RR_t* info = (scheduler_RR_t*)schedulerInfo;
+    schedulerRRCharge(info, currentTime);
+    list_node_t* node = list_tail(info->queue);
+    job_t* job = list_data(node);
+    list_remove(info->queue, node);
+    info->used = 0;
+    if (jobGetRemainingTime(job) > 0) {
+        // Quantum expired, move to the back of the queue
+        list_insert(info->queue, job);
+        job = NULL;
+    }
+    schedulerRRScheduleSlice(info, scheduler, currentTime);
+    return job;
+}
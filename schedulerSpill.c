@@ -0,0 +1,114 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "scheduler.h"
+#include "jobSpill.h"
+#include "job.h"
+
+// FCFS and LCFS on a queue that spills to disk
+// Only the job in service is a job object; waiting jobs have not started, so they are
+// kept as records in a jobSpill queue and recreated when they start. Memory stays
+// bounded however far an overloaded queue grows, and the completions are those of
+// the FCFS and LCFS policies. A segment that cannot be written or read back stops
+// the simulation, since the queue has lost a job.
+
+typedef struct {
+    job_spill_t* queue; // waiting jobs in arrival order
+    job_t* running; // job in service (NULL when idle)
+    bool lifo; // serve the latest arrival (LCFS) instead of the earliest (FCFS)
+} scheduler_spill_t;
+
+// Destroys scheduler specific info
+static void schedulerSpillDestroy(void* schedulerInfo)
+{
+    scheduler_spill_t* info = (scheduler_spill_t*)schedulerInfo;
+    if (info->running) {
+        jobDestroy(info->running);
+    }
+    jobSpillDestroy(info->queue);
+    free(info);
+}
+
+// Starts a job, or queues it behind the job in service
+static void schedulerSpillScheduleJob(void* schedulerInfo, scheduler_t* scheduler, job_t* job, uint64_t currentTime)
+{
+    scheduler_spill_t* info = (scheduler_spill_t*)schedulerInfo;
+    if (info->running == NULL) {
+        info->running = job;
+        schedulerScheduleNextCompletion(scheduler, currentTime + jobGetJobTime(job));
+        return;
+    }
+    job_spill_record_t record = {jobGetId(job), jobGetArrivalTime(job), jobGetJobTime(job)};
+    if (!jobSpillPushBack(info->queue, &record)) {
+        printf("Failed to queue job %" PRIu64 " in spilling queue\n", record.id);
+        simulatorStop(scheduler->sim);
+    }
+    jobDestroy(job);
+}
+
+// Completes the job in service and starts the next waiting job
+static job_t* schedulerSpillCompleteJob(void* schedulerInfo, scheduler_t* scheduler, uint64_t currentTime)
+{
+    scheduler_spill_t* info = (scheduler_spill_t*)schedulerInfo;
+    job_t* job = info->running;
+    info->running = NULL;
+    if (jobSpillCount(info->queue) > 0) {
+        job_spill_record_t record;
+        bool popped = info->lifo ? jobSpillPopBack(info->queue, &record) : jobSpillPopFront(info->queue, &record);
+        if (!popped) {
+            printf("Failed to take the next job from spilling queue\n");
+            simulatorStop(scheduler->sim);
+            return job;
+        }
+        info->running = jobCreate(record.arrivalTime, record.jobTime, record.id);
+        if (info->running == NULL) {
+            printf("Out of memory in spilling queue\n");
+            simulatorStop(scheduler->sim);
+            return job;
+        }
+        schedulerScheduleNextCompletion(scheduler, currentTime + record.jobTime);
+    }
+    return job;
+}
+
+static const scheduler_descriptor_t schedulerSpillDescriptors[] = {
+    {"FCFS", "first come first served", 0, NULL, schedulerSpillDestroy, schedulerSpillScheduleJob, schedulerSpillCompleteJob, NULL, NULL},
+    {"LCFS", "last come first served", 0, NULL, schedulerSpillDestroy, schedulerSpillScheduleJob, schedulerSpillCompleteJob, NULL, NULL},
+};
+
+// Returns true if a policy can run on a queue that spills to disk
+bool schedulerSpillSupported(const char* schedulerName)
+{
+    return strcmp(schedulerName, "FCFS") == 0 || strcmp(schedulerName, "LCFS") == 0;
+}
+
+// Creates an FCFS or LCFS scheduler whose waiting jobs spill to disk
+// schedulerName - FCFS or LCFS
+// spillDir - directory for the spilled jobs
+// memoryJobs - waiting jobs kept in memory
+// sim - simulator
+// completionCallback - function to call upon job completion
+// completionCallbackData - data to pass to completionCallback
+// Returns scheduler on success or NULL otherwise
+scheduler_t* schedulerSpillCreate(const char* schedulerName, const char* spillDir, size_t memoryJobs, simulator_t* sim,
+                                  completionCallback_fn completionCallback, void* completionCallbackData)
+{
+    if (!schedulerSpillSupported(schedulerName)) {
+        return NULL;
+    }
+    bool lifo = strcmp(schedulerName, "LCFS") == 0;
+    scheduler_spill_t* info = malloc(sizeof(scheduler_spill_t));
+    if (info == NULL) {
+        return NULL;
+    }
+    info->running = NULL;
+    info->lifo = lifo;
+    info->queue = jobSpillCreate(spillDir, memoryJobs);
+    if (info->queue == NULL) {
+        free(info);
+        return NULL;
+    }
+    return schedulerCreateWithInfo(&schedulerSpillDescriptors[lifo], info, sim, completionCallback, completionCallbackData);
+}
@@ -5,27 +5,16 @@
 // Events sorted by (time, type, id)
 int simulatorEventCompare(void* data1, void* data2)
 {
-    event_t* event1 = (event_t*)data1;
-    event_t* event2 = (event_t*)data2;
-    if (event1->timestamp < event2->timestamp) {
-        return -1;
-    } else if (event1->timestamp == event2->timestamp) {
-        if (event1->type < event2->type) {
-            return -1;
-        } else if (event1->type == event2->type) {
-            if (event1->id < event2->id) {
-                return -1;
-            } else if (event1->id == event2->id) {
-                return 0;
-            } else {
-                return 1;
-            }
-        } else {
-            return 1;
-        }
-    } else {
-        return 1;
-    }
+    event_key_t key1 = ((event_t*)data1)->key;
+    event_key_t key2 = ((event_t*)data2)->key;
+    return (key1 > key2) - (key1 < key2);
+}
+
+// Packs the ordering key of an event
+static inline event_key_t simulatorEventKey(uint64_t timestamp, event_type_t type, uint64_t id)
+{
+    assert(id < (UINT64_C(1) << 63)); // the id shares its word with the type
+    return (event_key_t)timestamp << 64 | (event_key_t)type << 63 | id;
 }
 
 // Create a discrete event simulator
@@ -38,6 +27,8 @@ simulator_t* simulatorCreate()
     sim->queue = list_create(simulatorEventCompare);
     sim->simTime = 0;
     sim->id = 0;
+    sim->numEvents = 0;
+    sim->stopped = false;
     if (sim->queue == NULL) {
         free(sim);
         return NULL;
@@ -69,9 +60,9 @@ list_node_t* simulatorSchedule(simulator_t* sim, uint64_t timestamp, event_type_
     if (event == NULL) {
         return NULL;
     }
+    event->key = simulatorEventKey(timestamp, type, sim->id++);
     event->timestamp = timestamp;
     event->type = type;
-    event->id = sim->id++;
     event->callback = callback;
     event->callbackData = callbackData;
     list_node_t* node = list_insert(sim->queue, event);
@@ -91,15 +82,114 @@ void simulatorRemoveEvent(simulator_t* sim, list_node_t* eventRef)
     list_remove(sim->queue, eventRef);
 }
 
-// Run simulation until no more events
+// Move an event to a new time without freeing and allocating it again
+// The event is ordered as if it was removed and scheduled again, and it is found
+// by walking from its current position, so moving it a short way is cheap
+// sim - simulator
+// eventRef - reference to the event to move, which is returned from simulatorSchedule
+// timestamp - new time of the event
+void simulatorRescheduleEvent(simulator_t* sim, list_node_t* eventRef, uint64_t timestamp)
+{
+    assert(timestamp >= simulatorSimTime(sim)); // ensure we don't go back in time
+    event_t* event = (event_t*)list_data(eventRef);
+    event->key = simulatorEventKey(timestamp, event->type, sim->id++);
+    event->timestamp = timestamp;
+    list_node_t* prev = list_prev(eventRef);
+    list_node_t* next = list_next(eventRef);
+    while (prev != list_end(sim->queue) && simulatorEventCompare(list_data(prev), event) > 0) {
+        next = prev;
+        prev = list_prev(prev);
+    }
+    if (next == list_next(eventRef)) {
+        while (next != list_end(sim->queue) && simulatorEventCompare(list_data(next), event) < 0) {
+            prev = next;
+            next = list_next(next);
+        }
+    }
+    if (prev == list_prev(eventRef) && next == list_next(eventRef)) {
+        return;
+    }
+    // Relink the node itself so the event reference stays valid
+    list_t* queue = sim->queue;
+    if (eventRef->prev) {
+        eventRef->prev->next = eventRef->next;
+    } else {
+        queue->head = eventRef->next;
+    }
+    if (eventRef->next) {
+        eventRef->next->prev = eventRef->prev;
+    } else {
+        queue->tail = eventRef->prev;
+    }
+    eventRef->prev = prev;
+    eventRef->next = next;
+    if (prev) {
+        prev->next = eventRef;
+    } else {
+        queue->head = eventRef;
+    }
+    if (next) {
+        next->prev = eventRef;
+    } else {
+        queue->tail = eventRef;
+    }
+}
+
+// Stop the simulation after a failure, no further events are run
+// The remaining events stay in the event queue until the simulator is destroyed
+void simulatorStop(simulator_t* sim)
+{
+    sim->stopped = true;
+}
+
+// Run simulation until no more events or until it is stopped
 void simulatorRun(simulator_t* sim)
 {
-    while (list_count(sim->queue) > 0) {
+    while (!sim->stopped && list_count(sim->queue) > 0) {
+        list_node_t* node = list_head(sim->queue);
+        event_t* event = (event_t*)list_data(node);
+        sim->simTime = event->timestamp;
+        sim->numEvents++;
+        event->callback(event->callbackData);
+        free(event);
+        list_remove(sim->queue, node);
+    }
+}
+
+// Run the next event
+// Returns false if there are no events or the simulation is stopped
+bool simulatorStep(simulator_t* sim)
+{
+    if (sim->stopped || list_count(sim->queue) == 0) {
+        return false;
+    }
+    list_node_t* node = list_head(sim->queue);
+    event_t* event = (event_t*)list_data(node);
+    sim->simTime = event->timestamp;
+    sim->numEvents++;
+    event->callback(event->callbackData);
+    free(event);
+    list_remove(sim->queue, node);
+    return true;
+}
+
+// Run all events with a timestamp up to and including the given time
+// Afterwards the simulator time is the given time, so new events can be scheduled at it
+void simulatorRunUntil(simulator_t* sim, uint64_t timestamp)
+{
+    while (!sim->stopped && list_count(sim->queue) > 0) {
         list_node_t* node = list_head(sim->queue);
         event_t* event = (event_t*)list_data(node);
+        if (event->timestamp > timestamp) {
+            break;
+        }
         sim->simTime = event->timestamp;
+        sim->numEvents++;
         event->callback(event->callbackData);
         free(event);
         list_remove(sim->queue, node);
     }
+    if (sim->simTime < timestamp) {
+        sim->simTime = timestamp;
+    }
 }
@@ -2,12 +2,15 @@
 #define SIMULATOR_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "linked_list.h"
 
 typedef struct {
     list_t* queue; // event queue in sorted order
     uint64_t simTime; // simulator current time
     uint64_t id; // current event id
+    uint64_t numEvents; // number of events run
+    bool stopped; // set by simulatorStop, no further events are run
 } simulator_t;
 
 typedef enum {
@@ -19,10 +22,14 @@ typedef enum {
 // Callback function will be called at the scheduled time with the provided callbackData
 typedef void (*event_callback)(void* callbackData);
 
+// Event ordering key, (timestamp, type, id) packed so that events compare as integers
+// The timestamp takes the high 64 bits, the type the next bit and the id the rest
+typedef unsigned __int128 event_key_t;
+
 typedef struct {
+    event_key_t key; // ordering key
     uint64_t timestamp; // time at which callback is invoked
     event_type_t type; // event type
-    uint64_t id; // event id
     event_callback callback; // callback to invoke
     void* callbackData; // data to pass to callback
 } event_t;
@@ -56,7 +63,27 @@ list_node_t* simulatorSchedule(simulator_t* sim, uint64_t timestamp, event_type_
 // eventRef - reference to the event to remove, which is returned from simulatorSchedule
 void simulatorRemoveEvent(simulator_t* sim, list_node_t* eventRef);
 
-// Run simulation until no more events
+// Move an event to a new time without freeing and allocating it again
+// The event is ordered as if it was removed and scheduled again, and it is found
+// by walking from its current position, so moving it a short way is cheap
+// sim - simulator
+// eventRef - reference to the event to move, which is returned from simulatorSchedule
+// timestamp - new time of the event
+void simulatorRescheduleEvent(simulator_t* sim, list_node_t* eventRef, uint64_t timestamp);
+
+// Stop the simulation after a failure, no further events are run
+// The remaining events stay in the event queue until the simulator is destroyed
+void simulatorStop(simulator_t* sim);
+
+// Run simulation until no more events or until it is stopped
 void simulatorRun(simulator_t* sim);
 
+// Run the next event
+// Returns false if there are no events or the simulation is stopped
+bool simulatorStep(simulator_t* sim);
+
+// Run all events with a timestamp up to and including the given time
+// Afterwards the simulator time is the given time, so new events can be scheduled at it
+void simulatorRunUntil(simulator_t* sim, uint64_t timestamp);
+
 #endif /* SIMULATOR_H */
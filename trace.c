@@ -3,11 +3,203 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
 #include "trace.h"
+#include "traceCache.h"
+#include "traceGzip.h"
+#include "traceIndex.h"
+#include "engine.h"
+#include "perfCounters.h"
 #include "simulator.h"
 #include "scheduler.h"
 #include "job.h"
 
+static void traceRunSimulator(trace_t* trace, const char* schedulerName, const trace_options_t* options);
+
+// Records in the prefetch ring, a power of two
+#define TRACE_PREFETCH_CAPACITY 4096
+// Bytes read from the trace file at a time by the prefetch thread
+#define TRACE_PREFETCH_CHUNK (1 << 16)
+// Times a side polls the ring before yielding the processor
+#define TRACE_PREFETCH_SPINS 64
+
+// Parsed trace record
+typedef struct {
+    uint64_t id; // job id
+    uint64_t arrivalTime; // arrival time
+    uint64_t jobTime; // job time
+} trace_record_t;
+
+// Background parser feeding a single-producer/single-consumer ring
+// The producer only writes tail and the consumer only writes head; each side
+// publishes with a release store and reads the other side's index with an acquire
+// load, so records are complete before they become visible.
+typedef struct trace_prefetch {
+    trace_record_t records[TRACE_PREFETCH_CAPACITY]; // ring of parsed records
+    size_t head __attribute__((aligned(64))); // next record to consume, written by the consumer
+    bool stop; // set by the consumer to stop the producer early
+    size_t tail __attribute__((aligned(64))); // next record to produce, written by the producer
+    bool done; // set by the producer after the last record
+    bool failed; // set by the producer before done if the trace could not be read to its end
+    FILE* file __attribute__((aligned(64))); // trace file, only read by the producer
+    pthread_t thread; // producer thread
+} trace_prefetch_t;
+
+// Waits for the other side of the prefetch ring
+// spins - polls so far, reset once the ring moved
+static void tracePrefetchWait(unsigned* spins)
+{
+    if (++*spins >= TRACE_PREFETCH_SPINS) {
+        sched_yield();
+        *spins = 0;
+    }
+}
+
+// Adds a record to the prefetch ring, waiting while it is full
+// Returns false if the consumer stopped
+static bool tracePrefetchPush(trace_prefetch_t* prefetch, const trace_record_t* record)
+{
+    size_t tail = prefetch->tail;
+    unsigned spins = 0;
+    while (tail - __atomic_load_n(&prefetch->head, __ATOMIC_ACQUIRE) == TRACE_PREFETCH_CAPACITY) {
+        if (__atomic_load_n(&prefetch->stop, __ATOMIC_RELAXED)) {
+            return false;
+        }
+        tracePrefetchWait(&spins);
+    }
+    prefetch->records[tail & (TRACE_PREFETCH_CAPACITY - 1)] = *record;
+    __atomic_store_n(&prefetch->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Takes the next record from the prefetch ring, waiting while it is empty
+// Returns false at the end of the trace
+static bool tracePrefetchPop(trace_prefetch_t* prefetch, trace_record_t* record)
+{
+    size_t head = prefetch->head;
+    unsigned spins = 0;
+    while (__atomic_load_n(&prefetch->tail, __ATOMIC_ACQUIRE) == head) {
+        if (__atomic_load_n(&prefetch->done, __ATOMIC_ACQUIRE)) {
+            // The last records may have been published just before done
+            if (__atomic_load_n(&prefetch->tail, __ATOMIC_ACQUIRE) == head) {
+                return false;
+            }
+            break;
+        }
+        tracePrefetchWait(&spins);
+    }
+    *record = prefetch->records[head & (TRACE_PREFETCH_CAPACITY - 1)];
+    __atomic_store_n(&prefetch->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Prefetch thread, parses the trace file in chunks into the ring
+// A read error or an invalid record ends the trace and marks it failed
+static void* tracePrefetchThread(void* p)
+{
+    trace_prefetch_t* prefetch = (trace_prefetch_t*)p;
+    char* buffer = malloc(TRACE_PREFETCH_CHUNK);
+    size_t length = 0;
+    long offset = 0; // file offset of the start of the buffer
+    bool eof = buffer == NULL;
+    prefetch->failed = buffer == NULL;
+    while (!eof && !__atomic_load_n(&prefetch->stop, __ATOMIC_RELAXED)) {
+        length += fread(buffer + length, 1, TRACE_PREFETCH_CHUNK - length, prefetch->file);
+        eof = length < TRACE_PREFETCH_CHUNK;
+        if (eof && ferror(prefetch->file)) {
+            printf("Failed to read trace\n");
+            prefetch->failed = true;
+            break;
+        }
+        // Before the end of the file, only parse up to the last complete line
+        const char* end = buffer + length;
+        if (!eof) {
+            while (end > buffer && end[-1] != '\n') {
+                end--;
+            }
+            if (end == buffer) {
+                // A line longer than the buffer is not a record
+                printf("Invalid trace line at offset %ld\n", offset);
+                prefetch->failed = true;
+                break;
+            }
+        }
+        const char* pos = buffer;
+        trace_record_t record;
+        const char* next;
+        while ((next = traceParseJob(pos, end, &record.id, &record.arrivalTime, &record.jobTime)) != NULL) {
+            if (!tracePrefetchPush(prefetch, &record)) {
+                eof = true;
+                break;
+            }
+            pos = next;
+        }
+        while (pos < end && isspace((unsigned char)*pos)) {
+            pos++;
+        }
+        if (pos != end) {
+            printf("Invalid trace line at offset %ld\n", offset + (long)(pos - buffer));
+            prefetch->failed = true;
+            break;
+        }
+        offset += end - buffer;
+        length = (size_t)(buffer + length - end);
+        memmove(buffer, end, length);
+    }
+    free(buffer);
+    __atomic_store_n(&prefetch->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Starts parsing a trace file on a background thread
+// Returns the prefetcher or NULL on failure
+static trace_prefetch_t* tracePrefetchStart(FILE* file)
+{
+    trace_prefetch_t* prefetch = aligned_alloc(64, sizeof(trace_prefetch_t));
+    if (prefetch == NULL) {
+        return NULL;
+    }
+    prefetch->head = 0;
+    prefetch->tail = 0;
+    prefetch->stop = false;
+    prefetch->done = false;
+    prefetch->failed = false;
+    prefetch->file = file;
+    if (pthread_create(&prefetch->thread, NULL, tracePrefetchThread, prefetch) != 0) {
+        free(prefetch);
+        return NULL;
+    }
+    return prefetch;
+}
+
+// Stops the background parser and frees it
+static void tracePrefetchStop(trace_prefetch_t* prefetch)
+{
+    __atomic_store_n(&prefetch->stop, true, __ATOMIC_RELAXED);
+    pthread_join(prefetch->thread, NULL);
+    free(prefetch);
+}
+
+// Stops prefetching, closes the trace and output files and frees the trace
+static void traceClose(trace_t* trace)
+{
+    if (trace->prefetch) {
+        tracePrefetchStop(trace->prefetch);
+    }
+    fclose(trace->outFile);
+    fclose(trace->traceFile);
+    free(trace->batch);
+    free(trace);
+}
+
 // Run a trace
 // traceFilename - path to trace file
 // outFilename - path to output file
@@ -15,16 +207,274 @@
 // Returns true on success, false otherwise
 bool traceRun(const char* traceFilename, const char* outFilename, const char* schedulerName)
 {
+    trace_options_t options;
+    traceOptionsInit(&options);
+    return traceRunWithOptions(traceFilename, outFilename, schedulerName, &options);
+}
+
+// Initializes trace run options to their defaults
+void traceOptionsInit(trace_options_t* options)
+{
+    options->engineName = "sequential";
+    options->numThreads = 1;
+    options->window = 64;
+    options->numQueues = 1;
+    options->routerName = "RR";
+    routerOptionsInit(&options->routerOptions);
+    options->prefetch = false;
+    options->genericLoop = false;
+    options->stats = false;
+    options->cacheDir = NULL;
+    options->cacheLimit = UINT64_C(1) << 30;
+    options->follow = false;
+    options->followIdle = 0;
+    options->fromTime = 0;
+    options->toTime = UINT64_MAX;
+    options->spillDir = NULL;
+    options->spillJobs = (size_t)1 << 20;
+    options->sample = false;
+    options->sampleInterval = 0;
+    options->counters = NULL;
+}
+
+// Returns true if the options restrict a run to a time window of the trace
+bool traceOptionsWindowed(const trace_options_t* options)
+{
+    return options->fromTime > 0 || options->toTime != UINT64_MAX;
+}
+
+// Set by SIGINT or SIGTERM to end follow mode
+static volatile sig_atomic_t traceFollowStopped = 0;
+
+// Ends follow mode
+static void traceFollowSignal(int signum)
+{
+    (void)signum;
+    traceFollowStopped = 1;
+}
+
+// Returns the monotonic time in milliseconds
+static uint64_t traceFollowNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// Waits until the trace file may have grown, for at most a tenth of a second
+// notifyFd - inotify descriptor watching the trace file, or -1 to just poll
+static void traceFollowWait(int notifyFd)
+{
+    struct pollfd pollFd = {.fd = notifyFd, .events = POLLIN};
+    if (poll(&pollFd, notifyFd >= 0 ? 1 : 0, 100) > 0) {
+        char events[4096];
+        while (read(notifyFd, events, sizeof(events)) > 0) {
+        }
+    }
+}
+
+// Runs the simulator over a trace that is still being appended to
+// Jobs arrive in order and completions go before arrivals at the same time, so once
+// a job is read every event up to its arrival time is final. Events are run up to
+// the arrival of the latest job read; at the end of the file the output is flushed
+// and the trace is watched for new lines. Follow mode ends on SIGINT or SIGTERM, or
+// after options->followIdle seconds without new jobs, and the trace is then run to
+// the end as if it was complete.
+// trace - trace with simulator and scheduler or dispatcher
+// traceFilename - path to trace file, watched for writes
+// options - trace run options
+static void traceRunFollow(trace_t* trace, const char* traceFilename, const trace_options_t* options)
+{
+    int notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd >= 0 && inotify_add_watch(notifyFd, traceFilename, IN_MODIFY) < 0) {
+        close(notifyFd);
+        notifyFd = -1;
+    }
+    struct sigaction action;
+    struct sigaction oldInt;
+    struct sigaction oldTerm;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = traceFollowSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &oldInt);
+    sigaction(SIGTERM, &action, &oldTerm);
+    traceFollowStopped = 0;
+
+    trace->follow = true;
+    traceScheduleNextArrival(trace);
+    uint64_t lastJobTime = traceFollowNow();
+    while (!traceFollowStopped && !trace->sim->stopped) {
+        if (trace->currentJob) {
+            simulatorRunUntil(trace->sim, jobGetArrivalTime(trace->currentJob));
+            lastJobTime = traceFollowNow();
+            continue;
+        }
+        fflush(trace->outFile);
+        if (options->followIdle && traceFollowNow() - lastJobTime >= options->followIdle * 1000) {
+            break;
+        }
+        traceFollowWait(notifyFd);
+        traceScheduleNextArrival(trace);
+    }
+    trace->follow = false;
+    if (trace->currentJob == NULL) {
+        traceScheduleNextArrival(trace);
+    }
+    simulatorRun(trace->sim);
+
+    sigaction(SIGINT, &oldInt, NULL);
+    sigaction(SIGTERM, &oldTerm, NULL);
+    if (notifyFd >= 0) {
+        close(notifyFd);
+    }
+}
+
+// Attaches an occupancy sampler to the queue or the dispatcher queues of a trace
+// With a sample interval, the series goes to outFilename.samples
+// series - set to the series file, or NULL without a sample interval
+// Returns the sampler or NULL on failure
+static scheduler_sampler_t* traceSampleStart(trace_t* trace, const char* outFilename, const trace_options_t* options, FILE** series)
+{
+    *series = NULL;
+    if (options->sampleInterval > 0) {
+        size_t len = strlen(outFilename) + sizeof(".samples");
+        char* seriesFilename = malloc(len);
+        if (seriesFilename == NULL) {
+            return NULL;
+        }
+        snprintf(seriesFilename, len, "%s.samples", outFilename);
+        *series = fopen(seriesFilename, "w");
+        if (*series == NULL) {
+            printf("Invalid sample file: %s\n", seriesFilename);
+            free(seriesFilename);
+            return NULL;
+        }
+        free(seriesFilename);
+    }
+    scheduler_sampler_t* sampler = schedulerSamplerCreate(options->numQueues, *series, options->sampleInterval);
+    if (sampler == NULL) {
+        if (*series) {
+            fclose(*series);
+        }
+        return NULL;
+    }
+    if (trace->dispatcher) {
+        for (size_t i = 0; i < trace->dispatcher->numQueues; i++) {
+            trace->dispatcher->queues[i].scheduler->sampler = sampler;
+        }
+    } else {
+        trace->scheduler->sampler = sampler;
+    }
+    return sampler;
+}
+
+// Prints the time averages of a sampler and destroys it, closing the series file
+static void traceSampleFinish(scheduler_sampler_t* sampler, FILE* series, const char* schedulerName)
+{
+    uint64_t period = sampler->lastTime - sampler->startTime;
+    double jobs = period ? (double)sampler->jobArea / (double)period : 0.0;
+    double utilization = period ? (double)sampler->busyArea / (double)period / (double)sampler->numQueues : 0.0;
+    printf("%s: %.6f jobs in system on average, utilization %.6f, at most %" PRIu64 " jobs over %" PRIu64 " time units\n",
+           schedulerName, jobs, utilization, sampler->maxJobs, period);
+    schedulerSamplerDestroy(sampler);
+    if (series) {
+        fclose(series);
+    }
+}
+
+// Run a trace with options without the result cache
+// traceFilename - path to trace file
+// outFilename - path to output file
+// scheduler - queue scheduler to evaluate
+// options - trace run options
+// Returns true on success, false otherwise
+static bool traceRunUncached(const char* traceFilename, const char* outFilename, const char* schedulerName, const trace_options_t* options)
+{
+    bool conservative = strcmp(options->engineName, "conservative") == 0;
+    bool optimistic = strcmp(options->engineName, "optimistic") == 0;
+    bool busyPeriod = strcmp(options->engineName, "busyperiod") == 0;
+    bool closedForm = strcmp(options->engineName, "closedform") == 0;
+    bool stack = strcmp(options->engineName, "stack") == 0;
+    bool heap = strcmp(options->engineName, "heap") == 0;
+    bool sequential = strcmp(options->engineName, "sequential") == 0;
+    if (!conservative && !optimistic && !busyPeriod && !closedForm && !stack && !heap && !sequential) {
+        printf("Invalid engine type: %s\n", options->engineName);
+        return false;
+    }
+    if (options->follow && (conservative || optimistic || busyPeriod || closedForm || stack || heap)) {
+        printf("Follow mode runs the sequential engine\n");
+        return false;
+    }
+    bool windowed = traceOptionsWindowed(options);
+    if (windowed && (conservative || optimistic || busyPeriod || closedForm || stack || heap || options->numQueues > 1 || options->follow)) {
+        printf("Time windows run a single queue on the sequential engine without follow mode\n");
+        return false;
+    }
+    bool spill = options->spillDir != NULL;
+    if (spill && !schedulerSpillSupported(schedulerName)) {
+        printf("Only FCFS and LCFS queues can spill\n");
+        return false;
+    }
+    if (spill && (conservative || optimistic || busyPeriod || closedForm || stack || heap || options->numQueues > 1)) {
+        printf("Spilling queues run a single queue on the sequential engine\n");
+        return false;
+    }
+    if (options->sample && (!sequential || windowed)) {
+        printf("Sampling runs the sequential engine over the whole trace\n");
+        return false;
+    }
+    if (options->counters && strcmp(options->counters, "run") != 0 && strcmp(options->counters, "policy") != 0) {
+        printf("Invalid counter scope: %s\n", options->counters);
+        return false;
+    }
+    if (options->counters && (!sequential || options->follow)) {
+        printf("Counters run on the sequential engine without follow mode\n");
+        return false;
+    }
+    if (options->toTime <= options->fromTime) {
+        printf("Invalid time window: %" PRIu64 " to %" PRIu64 "\n", options->fromTime, options->toTime);
+        return false;
+    }
     trace_t* trace = malloc(sizeof(trace_t));
     if (trace == NULL) {
         return false;
     }
+    trace->batch = NULL;
+    trace->batchCapacity = 0;
+    trace->prefetch = NULL;
+    trace->follow = false;
+    trace->windowed = windowed;
+    trace->fromTime = options->fromTime;
+    trace->toTime = options->toTime;
+    trace->busyUntil = 0;
+    trace->failed = false;
     trace->traceFile = fopen(traceFilename, "r");
     if (trace->traceFile == NULL) {
         printf("Invalid trace file: %s\n", traceFilename);
         free(trace);
         return false;
     }
+    if (traceGzipDetect(trace->traceFile)) {
+        FILE* stream = NULL;
+        if (options->follow) {
+            printf("Follow mode needs an uncompressed trace\n");
+        } else if ((stream = traceGzipOpen(trace->traceFile, options->numThreads)) == NULL) {
+            printf("Invalid compressed trace file: %s\n", traceFilename);
+        }
+        if (stream == NULL) {
+            fclose(trace->traceFile);
+            free(trace);
+            return false;
+        }
+        trace->traceFile = stream;
+    } else if (options->fromTime > 0) {
+        // Start at the last moment the system is empty before the window; without
+        // the index the run reads the trace from its start
+        uint64_t offset;
+        if (traceIndexFind(traceFilename, options->fromTime, &offset)) {
+            fseeko(trace->traceFile, (off_t)offset, SEEK_SET);
+        }
+    }
     trace->outFile = fopen(outFilename, "w");
     if (trace->outFile == NULL) {
         printf("Invalid output file: %s\n", outFilename);
@@ -32,54 +482,390 @@ bool traceRun(const char* traceFilename, const char* outFilename, const char* sc
         free(trace);
         return false;
     }
+    if (options->prefetch && !busyPeriod && !closedForm && !stack && !heap && !options->follow) {
+        // Engines that read the whole trace themselves do not use it, and the
+        // background parser stops at the end of the file
+        trace->prefetch = tracePrefetchStart(trace->traceFile);
+    }
+    if (conservative || optimistic || busyPeriod || closedForm || stack || heap) {
+        trace->sim = NULL;
+        trace->scheduler = NULL;
+        trace->dispatcher = NULL;
+        bool success;
+        if (conservative) {
+            success = engineConservativeRun(trace, schedulerName, options);
+        } else if (optimistic) {
+            success = engineOptimisticRun(trace, schedulerName, options);
+        } else if (busyPeriod) {
+            success = engineBusyPeriodRun(trace, schedulerName, options);
+        } else if (closedForm) {
+            success = engineClosedFormRun(trace, schedulerName, options);
+        } else if (stack) {
+            success = engineStackRun(trace, schedulerName, options);
+        } else {
+            success = engineHeapRun(trace, schedulerName, options);
+        }
+        success = success && !trace->failed;
+        traceClose(trace);
+        return success;
+    }
     trace->sim = simulatorCreate();
     if (trace->sim == NULL) {
-        fclose(trace->outFile);
-        fclose(trace->traceFile);
-        free(trace);
+        traceClose(trace);
         return false;
     }
-    trace->scheduler = schedulerCreate(schedulerName, trace->sim, traceCompletionCallback, trace);
-    if (trace->scheduler == NULL) {
+    trace->scheduler = NULL;
+    trace->dispatcher = NULL;
+    if (options->numQueues > 1) {
+        trace->dispatcher = dispatcherCreate(options->routerName, schedulerName, options->numQueues, &trace->sim, 1, &options->routerOptions, traceDispatcherCompletionCallback, trace);
+    } else if (spill) {
+        trace->scheduler = schedulerSpillCreate(schedulerName, options->spillDir, options->spillJobs, trace->sim, traceCompletionCallback, trace);
+    } else {
+        trace->scheduler = schedulerCreate(schedulerName, trace->sim, traceCompletionCallback, trace);
+    }
+    if (trace->scheduler == NULL && trace->dispatcher == NULL) {
         simulatorDestroy(trace->sim);
-        fclose(trace->outFile);
-        fclose(trace->traceFile);
-        free(trace);
+        traceClose(trace);
         return false;
     }
-    traceScheduleNextArrival(trace);
-    simulatorRun(trace->sim);
-    schedulerDestroy(trace->scheduler);
+    scheduler_sampler_t* sampler = NULL;
+    FILE* series = NULL;
+    if (options->sample) {
+        sampler = traceSampleStart(trace, outFilename, options, &series);
+        if (sampler == NULL) {
+            if (trace->dispatcher) {
+                dispatcherDestroy(trace->dispatcher);
+            } else {
+                schedulerDestroy(trace->scheduler);
+            }
+            simulatorDestroy(trace->sim);
+            traceClose(trace);
+            return false;
+        }
+    }
+    if (options->follow) {
+        traceRunFollow(trace, traceFilename, options);
+    } else {
+        traceScheduleNextArrival(trace);
+        traceRunSimulator(trace, schedulerName, options);
+    }
+    // A queue or trace read that failed stopped the simulator and reported the failure
+    bool success = !trace->sim->stopped && !trace->failed;
+    if (trace->currentJob) {
+        // Only a stopped simulation leaves an arrival that never ran
+        jobDestroy(trace->currentJob);
+    }
+    if (sampler) {
+        traceSampleFinish(sampler, series, schedulerName);
+    }
+    if (trace->dispatcher) {
+        dispatcherDestroy(trace->dispatcher);
+    } else {
+        schedulerDestroy(trace->scheduler);
+    }
     simulatorDestroy(trace->sim);
-    fclose(trace->outFile);
-    fclose(trace->traceFile);
-    free(trace);
-    return true;
+    traceClose(trace);
+    return success;
 }
 
-// Schedule the next arrival in the trace
+// Run a trace with options
+// With a cache directory, the output of an earlier run with the same trace contents,
+// scheduler and options is reused; policies loaded from plugins, sampled runs and
+// runs with counters always run
+// traceFilename - path to trace file
+// outFilename - path to output file
+// scheduler - queue scheduler to evaluate
+// options - trace run options
+// Returns true on success, false otherwise
+bool traceRunWithOptions(const char* traceFilename, const char* outFilename, const char* schedulerName, const trace_options_t* options)
+{
+    const scheduler_descriptor_t* descriptor = schedulerFind(schedulerName);
+    trace_cache_key_t key;
+    if (options->cacheDir == NULL || options->follow || options->sample || options->counters || descriptor == NULL || !schedulerIsBuiltin(descriptor) ||
+        !traceCacheKey(traceFilename, schedulerName, options, &key)) {
+        return traceRunUncached(traceFilename, outFilename, schedulerName, options);
+    }
+    if (traceCacheFetch(options->cacheDir, &key, outFilename)) {
+        return true;
+    }
+    bool success = traceRunUncached(traceFilename, outFilename, schedulerName, options);
+    if (success) {
+        traceCacheStore(options->cacheDir, &key, outFilename, options->cacheLimit);
+    }
+    return success;
+}
+
+// Read the next complete line of a trace that is still being appended to
+// A line without its newline is left for a later call, since its last number may
+// still be growing
 // trace - trace
-void traceScheduleNextArrival(trace_t* trace)
+// Returns the job or NULL if there is no complete line yet
+static job_t* traceFollowReadJob(trace_t* trace)
+{
+    FILE* file = trace->traceFile;
+    char line[128];
+    for (;;) {
+        long start = ftell(file);
+        if (fgets(line, sizeof(line), file) == NULL) {
+            clearerr(file);
+            return NULL;
+        }
+        size_t length = strlen(line);
+        if (line[length - 1] != '\n') {
+            int c = EOF;
+            if (!feof(file)) {
+                // Longer than any record, skip the rest of the line
+                while ((c = fgetc(file)) != EOF && c != '\n') {
+                }
+            }
+            if (c == EOF) {
+                fseek(file, start, SEEK_SET);
+                clearerr(file);
+                return NULL;
+            }
+            printf("Invalid trace line at offset %ld\n", start);
+            continue;
+        }
+        uint64_t id;
+        uint64_t arrivalTime;
+        uint64_t jobTime;
+        if (sscanf(line, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &id, &arrivalTime, &jobTime) == 3) {
+            job_t* job = jobCreate(arrivalTime, jobTime, id);
+            assert(job);
+            return job;
+        }
+        if (line[strspn(line, " \t\r\n")] != '\0') {
+            printf("Invalid trace line at offset %ld\n", start);
+        }
+    }
+}
+
+// Ends the trace after a read error, an invalid record or a failure to take in jobs
+// The simulation is stopped, so the run fails instead of writing a partial output
+// trace - trace
+static void traceReadFailed(trace_t* trace)
 {
+    trace->failed = true;
+    if (trace->sim) {
+        simulatorStop(trace->sim);
+    }
+}
+
+// Read the next job from the trace file, the prefetcher or the followed trace
+// trace - trace
+// Returns the job or NULL at the end of the trace or on failure
+static inline job_t* traceReadNextJob(trace_t* trace)
+{
+    if (trace->follow) {
+        return traceFollowReadJob(trace);
+    }
+    if (trace->prefetch) {
+        trace_record_t record;
+        if (!tracePrefetchPop(trace->prefetch, &record)) {
+            // Popping returned false after the producer set done, so failed is final
+            if (trace->prefetch->failed) {
+                traceReadFailed(trace);
+            }
+            return NULL;
+        }
+        job_t* job = jobCreate(record.arrivalTime, record.jobTime, record.id);
+        assert(job);
+        return job;
+    }
     uint64_t id;
     uint64_t arrivalTime;
     uint64_t jobTime;
-    if (fscanf(trace->traceFile, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &id, &arrivalTime, &jobTime) != 3) {
-        assert(feof(trace->traceFile));
+    int numFields = fscanf(trace->traceFile, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &id, &arrivalTime, &jobTime);
+    if (numFields != 3) {
+        if (ferror(trace->traceFile)) {
+            printf("Failed to read trace\n");
+            traceReadFailed(trace);
+        } else if (numFields != EOF) {
+            // Including a record cut short by the end of the file
+            printf("Invalid trace line at offset %ld\n", ftell(trace->traceFile));
+            traceReadFailed(trace);
+        }
+        return NULL;
+    }
+    job_t* job = jobCreate(arrivalTime, jobTime, id);
+    assert(job);
+    return job;
+}
+
+// Read the next job in the trace
+// A time window ends at the first job after it that arrives once all earlier work is
+// done, since until then later arrivals can still delay the window's jobs
+// trace - trace
+// Returns the job or NULL at the end of the trace
+job_t* traceReadJob(trace_t* trace)
+{
+    job_t* job = traceReadNextJob(trace);
+    if (job == NULL || !trace->windowed) {
+        return job;
+    }
+    uint64_t arrivalTime = jobGetArrivalTime(job);
+    if (arrivalTime >= trace->toTime && arrivalTime >= trace->busyUntil) {
+        jobDestroy(job);
+        return NULL;
+    }
+    trace->busyUntil = (arrivalTime > trace->busyUntil ? arrivalTime : trace->busyUntil) + jobGetJobTime(job);
+    return job;
+}
+
+// Returns true if a job's completion is written
+static inline bool traceWritesJob(trace_t* trace, job_t* job)
+{
+    return !trace->windowed || (jobGetArrivalTime(job) >= trace->fromTime && jobGetArrivalTime(job) < trace->toTime);
+}
+
+// Reads the rest of a trace file into memory
+// file - trace file
+// length - set to the number of bytes read
+// Returns the text, to be freed by the caller, or NULL on failure
+char* traceReadAll(FILE* file, size_t* length)
+{
+    size_t capacity = 1 << 16;
+    char* text = malloc(capacity);
+    *length = 0;
+    while (text != NULL) {
+        *length += fread(text + *length, 1, capacity - *length, file);
+        if (*length < capacity) {
+            if (ferror(file)) {
+                break;
+            }
+            return text;
+        }
+        capacity *= 2;
+        char* grown = realloc(text, capacity);
+        if (grown == NULL) {
+            break;
+        }
+        text = grown;
+    }
+    free(text);
+    return NULL;
+}
+
+// Parses the next "id,arrivalTime,jobTime" record of a trace held in memory
+// pos - start of the unparsed text
+// end - end of the text
+// Returns the position after the record or NULL if there is no further record
+const char* traceParseJob(const char* pos, const char* end, uint64_t* id, uint64_t* arrivalTime, uint64_t* jobTime)
+{
+    uint64_t* fields[3] = {id, arrivalTime, jobTime};
+    for (size_t i = 0; i < 3; i++) {
+        if (i > 0) {
+            if (pos == end || *pos != ',') {
+                return NULL;
+            }
+            pos++;
+        }
+        // Same leading whitespace as fscanf
+        while (pos < end && isspace((unsigned char)*pos)) {
+            pos++;
+        }
+        if (pos == end || *pos < '0' || *pos > '9') {
+            return NULL;
+        }
+        uint64_t value = 0;
+        while (pos < end && *pos >= '0' && *pos <= '9') {
+            value = value * 10 + (uint64_t)(*pos - '0');
+            pos++;
+        }
+        *fields[i] = value;
+    }
+    return pos;
+}
+
+// Initializes a writer
+// file - output file
+// Returns true on success, false otherwise
+bool traceWriterInit(trace_writer_t* writer, FILE* file)
+{
+    writer->file = file;
+    writer->size = 0;
+    writer->buffer = malloc(TRACE_WRITER_SIZE);
+    return writer->buffer != NULL;
+}
+
+// Writes the buffered output to the output file
+void traceWriterFlush(trace_writer_t* writer)
+{
+    fwrite(writer->buffer, 1, writer->size, writer->file);
+    writer->size = 0;
+}
+
+// Frees a writer's buffer, output that was not flushed is dropped
+void traceWriterDestroy(trace_writer_t* writer)
+{
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
+
+// Schedule the arrival of a job read from the trace
+// trace - trace
+// job - job to arrive next, or NULL at the end of the trace
+void traceScheduleArrival(trace_t* trace, job_t* job)
+{
+    trace->currentJob = job;
+    if (trace->currentJob == NULL) {
         return;
     }
-    trace->currentJob = jobCreate(arrivalTime, jobTime, id);
-    assert(trace->currentJob);
     list_node_t* eventRef = simulatorSchedule(trace->sim, jobGetArrivalTime(trace->currentJob), EVENT_ARRIVAL, traceArrivalCallback, trace);
     assert(eventRef);
 }
 
+// Schedule the next arrival in the trace
+// trace - trace
+void traceScheduleNextArrival(trace_t* trace)
+{
+    traceScheduleArrival(trace, traceReadJob(trace));
+}
+
+// Delivers the current job and all following jobs with the same arrival time at once
+// trace - trace
+static void traceArriveBatch(trace_t* trace)
+{
+    uint64_t arrivalTime = jobGetArrivalTime(trace->currentJob);
+    size_t numJobs = 0;
+    job_t* job = trace->currentJob;
+    do {
+        if (numJobs == trace->batchCapacity) {
+            size_t capacity = trace->batchCapacity ? 2 * trace->batchCapacity : 16;
+            job_t** batch = realloc(trace->batch, capacity * sizeof(job_t*));
+            if (batch == NULL) {
+                printf("Out of memory in arrival batch\n");
+                for (size_t i = 0; i < numJobs; i++) {
+                    jobDestroy(trace->batch[i]);
+                }
+                jobDestroy(job);
+                trace->currentJob = NULL;
+                traceReadFailed(trace);
+                return;
+            }
+            trace->batch = batch;
+            trace->batchCapacity = capacity;
+        }
+        trace->batch[numJobs++] = job;
+        job = traceReadJob(trace);
+    } while (job && jobGetArrivalTime(job) == arrivalTime);
+    schedulerScheduleJobBatch(trace->scheduler, trace->batch, numJobs);
+    traceScheduleArrival(trace, job);
+}
+
 // Called when there's a job arrival
 // t - trace
 void traceArrivalCallback(void* t)
 {
     trace_t* trace = (trace_t*)t;
-    schedulerScheduleJob(trace->scheduler, trace->currentJob);
+    if (trace->dispatcher) {
+        dispatcherScheduleJob(trace->dispatcher, trace->currentJob);
+    } else if (trace->scheduler->scheduleJobBatch) {
+        traceArriveBatch(trace);
+        return;
+    } else {
+        schedulerScheduleJob(trace->scheduler, trace->currentJob);
+    }
     traceScheduleNextArrival(trace);
 }
 
@@ -88,6 +874,174 @@ void traceArrivalCallback(void* t)
 void traceCompletionCallback(void* t, job_t* job)
 {
     trace_t* trace = (trace_t*)t;
-    fprintf(trace->outFile, "%" PRIu64 ",%" PRIu64 "\n", jobGetId(job), simulatorSimTime(trace->sim));
+    if (traceWritesJob(trace, job)) {
+        fprintf(trace->outFile, "%" PRIu64 ",%" PRIu64 "\n", jobGetId(job), simulatorSimTime(trace->sim));
+    }
+    jobDestroy(job);
+}
+
+// Called when there's a job completion at a dispatcher queue
+// t - trace
+void traceDispatcherCompletionCallback(void* t, job_t* job, uint64_t completionTime)
+{
+    trace_t* trace = (trace_t*)t;
+    if (traceWritesJob(trace, job)) {
+        fprintf(trace->outFile, "%" PRIu64 ",%" PRIu64 "\n", jobGetId(job), completionTime);
+    }
     jobDestroy(job);
 }
+
+// Runs the simulator for a single queue with the given policy functions
+// Every arrival event is the trace's next job and every completion event is the
+// scheduler's, as set up by traceRunUncached, so events are dispatched on their type
+// rather than through their callbacks, in the same order as simulatorRun. Each
+// policy's loop passes its functions as constants, so they are called directly and,
+// with link-time optimization, inlined into the loop.
+// scheduleJob - policy schedule function, NULL for a policy that takes arrivals in batches
+// completeJob - policy complete function
+static inline __attribute__((always_inline)) void traceRunLoop(trace_t* trace, schedule_job_fn scheduleJob, complete_job_fn completeJob)
+{
+    simulator_t* sim = trace->sim;
+    scheduler_t* scheduler = trace->scheduler;
+    while (!sim->stopped && list_count(sim->queue) > 0) {
+        list_node_t* node = list_head(sim->queue);
+        event_t* event = (event_t*)list_data(node);
+        sim->simTime = event->timestamp;
+        sim->numEvents++;
+        if (event->type == EVENT_COMPLETION) {
+            schedulerCompleteJobWith(scheduler, completeJob);
+        } else if (scheduleJob) {
+            schedulerScheduleJobWith(scheduler, scheduleJob, trace->currentJob);
+            traceScheduleNextArrival(trace);
+        } else {
+            traceArriveBatch(trace);
+        }
+        free(event);
+        list_remove(sim->queue, node);
+    }
+}
+
+// Defines the run loop of a policy
+#define DEFINE_TRACE_LOOP(schedulerName, scheduleJob)                   \
+    static void traceRunLoop ## schedulerName(trace_t* trace)           \
+    {                                                                   \
+        traceRunLoop(trace, scheduleJob, scheduler ## schedulerName ## CompleteJob); \
+    }
+
+DEFINE_TRACE_LOOP(FCFS, schedulerFCFSScheduleJob)
+DEFINE_TRACE_LOOP(LCFS, schedulerLCFSScheduleJob)
+DEFINE_TRACE_LOOP(SJF, schedulerSJFScheduleJob)
+DEFINE_TRACE_LOOP(PLCFS, schedulerPLCFSScheduleJob)
+DEFINE_TRACE_LOOP(PSJF, schedulerPSJFScheduleJob)
+DEFINE_TRACE_LOOP(SRPT, schedulerSRPTScheduleJob)
+DEFINE_TRACE_LOOP(PS, schedulerPSScheduleJob)
+DEFINE_TRACE_LOOP(FB, schedulerFBScheduleJob)
+DEFINE_TRACE_LOOP(RR, NULL)
+DEFINE_TRACE_LOOP(MLFQ, NULL)
+
+// Per-policy run loop, found by the policy's complete function
+typedef struct {
+    complete_job_fn completeJob; // policy complete function
+    void (*run)(trace_t* trace); // run loop for the policy
+} trace_loop_t;
+
+#define TRACE_LOOP(schedulerName) {scheduler ## schedulerName ## CompleteJob, traceRunLoop ## schedulerName}
+
+static const trace_loop_t traceLoops[] = {
+    TRACE_LOOP(FCFS),
+    TRACE_LOOP(LCFS),
+    TRACE_LOOP(SJF),
+    TRACE_LOOP(PLCFS),
+    TRACE_LOOP(PSJF),
+    TRACE_LOOP(SRPT),
+    TRACE_LOOP(PS),
+    TRACE_LOOP(FB),
+    TRACE_LOOP(RR),
+    TRACE_LOOP(MLFQ),
+};
+
+// Sets the counters run inside the policy's functions of the trace's queues
+// counters - counters, or NULL to stop counting
+static void traceSetCounters(trace_t* trace, perf_counters_t* counters)
+{
+    if (trace->dispatcher) {
+        for (size_t i = 0; i < trace->dispatcher->numQueues; i++) {
+            trace->dispatcher->queues[i].scheduler->counters = counters;
+        }
+    } else {
+        trace->scheduler->counters = counters;
+    }
+}
+
+// Prints counter values per million events
+// policy - the counters ran inside the policy's functions rather than around the run loop
+static void traceCountersReport(perf_counters_t* counters, const char* schedulerName, bool policy, uint64_t numEvents)
+{
+    if (counters->leader < 0) {
+        printf("%s: hardware counters are not available: %s\n", schedulerName, strerror(counters->error));
+        return;
+    }
+    uint64_t values[PERF_COUNTERS_NUM];
+    perfCountersRead(counters, values);
+    double perMillion = numEvents ? 1e6 / (double)numEvents : 0.0;
+    printf("%s: per million events %s:", schedulerName, policy ? "in the policy" : "in the run loop");
+    for (size_t i = 0; i < PERF_COUNTERS_NUM; i++) {
+        if (values[i] == PERF_COUNTERS_UNAVAILABLE) {
+            printf("%s %s n/a", i ? "," : "", perfCountersName(i));
+        } else {
+            printf("%s %s %.0f", i ? "," : "", perfCountersName(i), (double)values[i] * perMillion);
+        }
+    }
+    if (values[0] != PERF_COUNTERS_UNAVAILABLE && values[1] != PERF_COUNTERS_UNAVAILABLE && values[0] > 0) {
+        printf(", IPC %.2f", (double)values[1] / (double)values[0]);
+    }
+    printf("\n");
+}
+
+// Runs the sequential engine's simulator
+// A single queue of a built-in policy runs the policy's own loop unless the generic
+// loop was asked for; dispatchers and plugin policies use simulatorRun
+// trace - trace with simulator and scheduler or dispatcher
+// schedulerName - name of scheduler, for the statistics
+// options - trace run options
+static void traceRunSimulator(trace_t* trace, const char* schedulerName, const trace_options_t* options)
+{
+    void (*run)(trace_t* trace) = NULL;
+    for (size_t i = 0; trace->scheduler && !options->genericLoop && i < sizeof(traceLoops) / sizeof(traceLoops[0]); i++) {
+        if (trace->scheduler->completeJob == traceLoops[i].completeJob) {
+            run = traceLoops[i].run;
+        }
+    }
+    perf_counters_t* counters = options->counters ? perfCountersCreate() : NULL;
+    bool policyCounters = counters && strcmp(options->counters, "policy") == 0;
+    if (policyCounters) {
+        traceSetCounters(trace, counters);
+    }
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (counters && !policyCounters) {
+        perfCountersStart(counters);
+    }
+    if (run) {
+        run(trace);
+    } else {
+        simulatorRun(trace->sim);
+    }
+    if (counters && !policyCounters) {
+        perfCountersStop(counters);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (counters) {
+        if (policyCounters) {
+            traceSetCounters(trace, NULL);
+        }
+        traceCountersReport(counters, schedulerName, policyCounters, trace->sim->numEvents);
+        perfCountersDestroy(counters);
+    }
+    if (options->stats) {
+        double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%s: %" PRIu64 " events in %.3f s with the %s loop, %.0f events/s\n", schedulerName, trace->sim->numEvents, seconds,
+               run ? "per-policy" : "generic", seconds > 0 ? (double)trace->sim->numEvents / seconds : 0.0);
+    }
+}
@@ -5,16 +5,59 @@
 #include <stdbool.h>
 #include "simulator.h"
 #include "scheduler.h"
+#include "dispatcher.h"
 #include "job.h"
 
+// Trace run options
+typedef struct {
+    const char* engineName; // simulation engine
+    size_t numThreads; // number of threads for parallel engines
+    uint64_t window; // how far past the GVT the optimistic engine speculates
+    size_t numQueues; // number of queues behind a dispatcher (1 runs a single queue without dispatcher)
+    const char* routerName; // dispatcher routing policy
+    router_options_t routerOptions; // dispatcher routing policy options
+    bool prefetch; // parse the trace ahead on a background thread
+    bool genericLoop; // run the sequential engine with the generic simulator loop instead of the per-policy one
+    bool stats; // print the number of events and events per second of the sequential engine
+    const char* cacheDir; // directory of cached outputs (NULL runs without the cache)
+    uint64_t cacheLimit; // total size in bytes of the cached outputs
+    bool follow; // keep reading the trace as it is appended to
+    uint64_t followIdle; // seconds without new jobs that end follow mode (0 waits for a signal)
+    uint64_t fromTime; // only jobs arriving at or after this time are written
+    uint64_t toTime; // only jobs arriving before this time are written (UINT64_MAX for the whole trace)
+    const char* spillDir; // directory the waiting jobs of FCFS and LCFS spill to (NULL keeps them in memory)
+    size_t spillJobs; // waiting jobs kept in memory when spilling
+    bool sample; // print the time-average number in system and utilization
+    uint64_t sampleInterval; // length of the intervals written to outFile.samples (0 writes none)
+    const char* counters; // where hardware counters run: "run" around the run loop, "policy" inside the policy's functions (NULL for nowhere)
+} trace_options_t;
+
+typedef struct trace_prefetch trace_prefetch_t;
+
 typedef struct {
     FILE* traceFile; // trace file
     FILE* outFile; // output file
     simulator_t* sim; // simulator
-    scheduler_t* scheduler; // scheduler
+    scheduler_t* scheduler; // scheduler (NULL when running a dispatcher)
+    dispatcher_t* dispatcher; // dispatcher (NULL when running a single queue)
     job_t* currentJob; // current job
+    trace_prefetch_t* prefetch; // background parser (NULL when reading the trace file directly)
+    job_t** batch; // jobs arriving at the current time, for schedulers that take them at once
+    size_t batchCapacity; // allocated batch entries
+    bool follow; // the trace is still being appended to, so a line without a newline is not read yet
+    bool windowed; // only jobs arriving in [fromTime, toTime) are written
+    uint64_t fromTime; // start of the time window
+    uint64_t toTime; // end of the time window
+    uint64_t busyUntil; // time at which the work of the jobs read so far is done
+    bool failed; // the trace could not be read to its end, the run fails
 } trace_t;
 
+// Initializes trace run options to their defaults
+void traceOptionsInit(trace_options_t* options);
+
+// Returns true if the options restrict a run to a time window of the trace
+bool traceOptionsWindowed(const trace_options_t* options);
+
 // Run a trace
 // traceFilename - path to trace file
 // outFilename - path to output file
@@ -22,6 +65,91 @@ typedef struct {
 // Returns true on success, false otherwise
 bool traceRun(const char* traceFilename, const char* outFilename, const char* schedulerName);
 
+// Run a trace with options
+// traceFilename - path to trace file
+// outFilename - path to output file
+// scheduler - queue scheduler to evaluate
+// options - trace run options
+// Returns true on success, false otherwise
+bool traceRunWithOptions(const char* traceFilename, const char* outFilename, const char* schedulerName, const trace_options_t* options);
+
+// Read the next job in the trace
+// trace - trace
+// Returns the job or NULL at the end of the trace
+job_t* traceReadJob(trace_t* trace);
+
+// Reads the rest of a trace file into memory
+// file - trace file
+// length - set to the number of bytes read
+// Returns the text, to be freed by the caller, or NULL on failure
+char* traceReadAll(FILE* file, size_t* length);
+
+// Parses the next "id,arrivalTime,jobTime" record of a trace held in memory
+// pos - start of the unparsed text
+// end - end of the text
+// Returns the position after the record or NULL if there is no further record
+const char* traceParseJob(const char* pos, const char* end, uint64_t* id, uint64_t* arrivalTime, uint64_t* jobTime);
+
+// Longest "id,completionTime" output line, two 20 digit numbers, a comma and a newline
+#define TRACE_COMPLETION_MAX_LENGTH 42
+
+// Writes an "id,completionTime" output line
+// out - where to write, with room for TRACE_COMPLETION_MAX_LENGTH bytes
+// Returns the position after the line
+static inline char* traceFormatCompletion(char* out, uint64_t id, uint64_t completionTime)
+{
+    uint64_t values[2] = {id, completionTime};
+    for (size_t i = 0; i < 2; i++) {
+        char digits[20];
+        size_t numDigits = 0;
+        uint64_t value = values[i];
+        do {
+            digits[numDigits++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (numDigits) {
+            *out++ = digits[--numDigits];
+        }
+        *out++ = i == 0 ? ',' : '\n';
+    }
+    return out;
+}
+
+// Buffered writer of output lines, for engines that write completions themselves
+typedef struct {
+    FILE* file; // output file
+    char* buffer; // buffered output
+    size_t size; // bytes of buffered output
+} trace_writer_t;
+
+// Bytes of output a writer buffers before writing
+#define TRACE_WRITER_SIZE (1 << 16)
+
+// Initializes a writer
+// file - output file
+// Returns true on success, false otherwise
+bool traceWriterInit(trace_writer_t* writer, FILE* file);
+
+// Writes the buffered output to the output file
+void traceWriterFlush(trace_writer_t* writer);
+
+// Frees a writer's buffer, output that was not flushed is dropped
+void traceWriterDestroy(trace_writer_t* writer);
+
+// Writes a job completion
+static inline void traceWriterComplete(trace_writer_t* writer, uint64_t id, uint64_t completionTime)
+{
+    if (writer->size + TRACE_COMPLETION_MAX_LENGTH > TRACE_WRITER_SIZE) {
+        traceWriterFlush(writer);
+    }
+    writer->size = (size_t)(traceFormatCompletion(writer->buffer + writer->size, id, completionTime) - writer->buffer);
+}
+
+// Schedule the arrival of a job read from the trace
+// trace - trace
+// job - job to arrive next, or NULL at the end of the trace
+void traceScheduleArrival(trace_t* trace, job_t* job);
+
 // Schedule the next arrival in the trace
 // trace - trace
 void traceScheduleNextArrival(trace_t* trace);
@@ -34,4 +162,8 @@ void traceArrivalCallback(void* t);
 // t - trace
 void traceCompletionCallback(void* t, job_t* job);
 
+// Called when there's a job completion at a dispatcher queue
+// t - trace
+void traceDispatcherCompletionCallback(void* t, job_t* job, uint64_t completionTime);
+
 #endif /* TRACE_H */
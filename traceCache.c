@@ -0,0 +1,323 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "traceCache.h"
+
+// Result cache
+//
+// The output of a run depends only on the trace text, the scheduler with its
+// parameters, the dispatcher options and the simulator itself; every engine writes
+// the same output. The simulator is hashed as the running executable, so a rebuild
+// after any source change gets new keys. Outputs are stored in the cache directory
+// under a 128-bit hash of all of these, so a sweep or CI job that runs the same
+// trace and policy again copies the earlier output instead of simulating. Each output is written to a
+// temporary file and renamed into place, so concurrent runs never see a partial
+// entry. A hit refreshes the entry's modification time, and stores trim the
+// directory to its size limit by deleting the least recently used entries.
+
+// Bytes read at a time when hashing and copying
+#define TRACE_CACHE_CHUNK (1 << 16)
+
+// Length of a cache entry name, the key in hexadecimal
+#define TRACE_CACHE_NAME_LENGTH 32
+
+// Streaming hash over two 64-bit lanes
+typedef struct {
+    uint64_t a; // first lane
+    uint64_t b; // second lane
+} trace_cache_hash_t;
+
+// Cache entry found while evicting
+typedef struct {
+    char name[TRACE_CACHE_NAME_LENGTH + 1]; // file name
+    time_t lastUsed; // modification time
+    uint64_t size; // size in bytes
+} trace_cache_entry_t;
+
+// Finalizes a 64-bit value so every input bit affects every output bit
+static inline uint64_t traceCacheMix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= UINT64_C(0xFF51AFD7ED558CCD);
+    x ^= x >> 33;
+    x *= UINT64_C(0xC4CEB9FE1A85EC53);
+    x ^= x >> 33;
+    return x;
+}
+
+// Adds one 64-bit word to the hash
+static inline void traceCacheHashWord(trace_cache_hash_t* hash, uint64_t word)
+{
+    hash->a = (hash->a ^ word) * UINT64_C(0x9E3779B97F4A7C15);
+    hash->a = (hash->a << 29) | (hash->a >> 35);
+    hash->b = (hash->b + word) * UINT64_C(0xC2B2AE3D27D4EB4F);
+    hash->b ^= hash->b >> 31;
+}
+
+// Adds bytes to the hash, followed by their length so field boundaries count
+static void traceCacheHashBytes(trace_cache_hash_t* hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        traceCacheHashWord(hash, word);
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, length - i);
+        traceCacheHashWord(hash, word);
+    }
+    traceCacheHashWord(hash, length);
+}
+
+// Adds a string to the hash, NULL hashes differently from the empty string
+static void traceCacheHashString(trace_cache_hash_t* hash, const char* str)
+{
+    if (str == NULL) {
+        traceCacheHashWord(hash, UINT64_MAX);
+    } else {
+        traceCacheHashBytes(hash, str, strlen(str));
+    }
+}
+
+// Adds the contents of a file to the hash
+// Returns true on success, false if the file could not be read
+static bool traceCacheHashFile(trace_cache_hash_t* hash, const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    char* buffer = malloc(TRACE_CACHE_CHUNK);
+    if (file == NULL || buffer == NULL) {
+        if (file) {
+            fclose(file);
+        }
+        free(buffer);
+        return false;
+    }
+    size_t length;
+    while ((length = fread(buffer, 1, TRACE_CACHE_CHUNK, file)) > 0) {
+        traceCacheHashBytes(hash, buffer, length);
+    }
+    bool success = !ferror(file);
+    fclose(file);
+    free(buffer);
+    return success;
+}
+
+// Hash of the running executable, computed once per process
+static pthread_once_t traceCacheBuildOnce = PTHREAD_ONCE_INIT;
+static trace_cache_hash_t traceCacheBuild;
+static bool traceCacheBuildValid;
+
+// Hashes the running executable
+static void traceCacheHashBuild(void)
+{
+    traceCacheBuild.a = 0;
+    traceCacheBuild.b = 0;
+    traceCacheBuildValid = traceCacheHashFile(&traceCacheBuild, "/proc/self/exe");
+}
+
+// Computes the cache key of a run
+// traceFilename - path to trace file, hashed by content
+// schedulerName - name of scheduler with its parameters
+// options - trace run options, only those that change the output are hashed
+// key - set to the cache key
+// Returns true on success, false if the trace or the running executable could not be read
+bool traceCacheKey(const char* traceFilename, const char* schedulerName, const trace_options_t* options, trace_cache_key_t* key)
+{
+    pthread_once(&traceCacheBuildOnce, traceCacheHashBuild);
+    if (!traceCacheBuildValid) {
+        return false;
+    }
+    trace_cache_hash_t hash = {.a = TRACE_CACHE_VERSION, .b = ~(uint64_t)TRACE_CACHE_VERSION};
+    traceCacheHashWord(&hash, traceCacheBuild.a);
+    traceCacheHashWord(&hash, traceCacheBuild.b);
+    bool success = traceCacheHashFile(&hash, traceFilename);
+    traceCacheHashString(&hash, schedulerName);
+    traceCacheHashWord(&hash, options->numQueues);
+    if (options->numQueues > 1) {
+        const router_options_t* routerOptions = &options->routerOptions;
+        traceCacheHashString(&hash, options->routerName);
+        traceCacheHashWord(&hash, routerOptions->d);
+        traceCacheHashWord(&hash, routerOptions->seed);
+        traceCacheHashWord(&hash, routerOptions->cutoffs != NULL);
+        if (routerOptions->cutoffs) {
+            traceCacheHashBytes(&hash, routerOptions->cutoffs, routerOptions->numCutoffs * sizeof(uint64_t));
+        }
+    }
+    if (traceOptionsWindowed(options)) {
+        traceCacheHashWord(&hash, options->fromTime);
+        traceCacheHashWord(&hash, options->toTime);
+    }
+    key->words[0] = traceCacheMix(hash.a ^ traceCacheMix(hash.b));
+    key->words[1] = traceCacheMix(hash.b + hash.a * UINT64_C(0x9E3779B97F4A7C15));
+    return success;
+}
+
+// Builds the path of a file in the cache directory
+// Returns the path, to be freed by the caller, or NULL on failure
+static char* traceCachePath(const char* cacheDir, const char* name)
+{
+    size_t len = strlen(cacheDir) + strlen(name) + 2;
+    char* path = malloc(len);
+    if (path != NULL) {
+        snprintf(path, len, "%s/%s", cacheDir, name);
+    }
+    return path;
+}
+
+// Builds the path of a cache entry
+// Returns the path, to be freed by the caller, or NULL on failure
+static char* traceCacheEntryPath(const char* cacheDir, const trace_cache_key_t* key)
+{
+    char name[TRACE_CACHE_NAME_LENGTH + 1];
+    snprintf(name, sizeof(name), "%016" PRIx64 "%016" PRIx64, key->words[0], key->words[1]);
+    return traceCachePath(cacheDir, name);
+}
+
+// Copies a file
+// Returns true on success, false otherwise
+static bool traceCacheCopy(const char* fromFilename, const char* toFilename)
+{
+    FILE* from = fopen(fromFilename, "r");
+    if (from == NULL) {
+        return false;
+    }
+    FILE* to = fopen(toFilename, "w");
+    char* buffer = malloc(TRACE_CACHE_CHUNK);
+    bool success = to != NULL && buffer != NULL;
+    size_t length;
+    while (success && (length = fread(buffer, 1, TRACE_CACHE_CHUNK, from)) > 0) {
+        success = fwrite(buffer, 1, length, to) == length;
+    }
+    success = success && !ferror(from);
+    free(buffer);
+    if (to && fclose(to) != 0) {
+        success = false;
+    }
+    fclose(from);
+    return success;
+}
+
+// Copies a cached output to the output file
+// cacheDir - cache directory
+// key - cache key of the run
+// outFilename - path to output file
+// Returns true if the output was cached and copied, false otherwise
+bool traceCacheFetch(const char* cacheDir, const trace_cache_key_t* key, const char* outFilename)
+{
+    char* path = traceCacheEntryPath(cacheDir, key);
+    if (path == NULL) {
+        return false;
+    }
+    bool success = access(path, R_OK) == 0 && traceCacheCopy(path, outFilename);
+    if (success) {
+        // Mark as recently used for eviction
+        utime(path, NULL);
+    }
+    free(path);
+    return success;
+}
+
+// Orders cache entries from least to most recently used
+static int traceCacheEntryCompare(const void* data1, const void* data2)
+{
+    const trace_cache_entry_t* entry1 = (const trace_cache_entry_t*)data1;
+    const trace_cache_entry_t* entry2 = (const trace_cache_entry_t*)data2;
+    if (entry1->lastUsed != entry2->lastUsed) {
+        return entry1->lastUsed < entry2->lastUsed ? -1 : 1;
+    }
+    return strcmp(entry1->name, entry2->name);
+}
+
+// Returns true if a file name is that of a cache entry
+static bool traceCacheIsEntry(const char* name)
+{
+    size_t length = strspn(name, "0123456789abcdef");
+    return length == TRACE_CACHE_NAME_LENGTH && name[length] == '\0';
+}
+
+// Deletes the least recently used entries until the cache fits its size limit
+static void traceCacheEvict(const char* cacheDir, uint64_t limit)
+{
+    DIR* dir = opendir(cacheDir);
+    if (dir == NULL) {
+        return;
+    }
+    trace_cache_entry_t* entries = NULL;
+    size_t numEntries = 0;
+    size_t capacity = 0;
+    uint64_t total = 0;
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(dir)) != NULL) {
+        if (!traceCacheIsEntry(dirEntry->d_name)) {
+            continue;
+        }
+        char* path = traceCachePath(cacheDir, dirEntry->d_name);
+        struct stat status;
+        if (path == NULL || stat(path, &status) != 0 || !S_ISREG(status.st_mode)) {
+            free(path);
+            continue;
+        }
+        free(path);
+        if (numEntries == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            trace_cache_entry_t* grown = realloc(entries, capacity * sizeof(trace_cache_entry_t));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        trace_cache_entry_t* entry = &entries[numEntries++];
+        memcpy(entry->name, dirEntry->d_name, sizeof(entry->name));
+        entry->lastUsed = status.st_mtime;
+        entry->size = (uint64_t)status.st_size;
+        total += entry->size;
+    }
+    closedir(dir);
+    if (total > limit) {
+        qsort(entries, numEntries, sizeof(trace_cache_entry_t), traceCacheEntryCompare);
+        for (size_t i = 0; i < numEntries && total > limit; i++) {
+            char* path = traceCachePath(cacheDir, entries[i].name);
+            if (path != NULL && unlink(path) == 0) {
+                total -= entries[i].size;
+            }
+            free(path);
+        }
+    }
+    free(entries);
+}
+
+// Adds a run's output to the cache and evicts the least recently used outputs
+// cacheDir - cache directory, created if missing
+// key - cache key of the run
+// outFilename - path to output file
+// limit - total size in bytes the cached outputs are trimmed to
+void traceCacheStore(const char* cacheDir, const trace_cache_key_t* key, const char* outFilename, uint64_t limit)
+{
+    if (mkdir(cacheDir, 0777) != 0 && errno != EEXIST) {
+        printf("Failed to create cache directory: %s\n", cacheDir);
+        return;
+    }
+    char* path = traceCacheEntryPath(cacheDir, key);
+    size_t len = path ? strlen(path) + 32 : 0;
+    char* tmpPath = path ? malloc(len) : NULL;
+    if (tmpPath != NULL) {
+        snprintf(tmpPath, len, "%s.%ld.tmp", path, (long)getpid());
+        if (!traceCacheCopy(outFilename, tmpPath) || rename(tmpPath, path) != 0) {
+            unlink(tmpPath);
+        }
+    }
+    free(tmpPath);
+    free(path);
+    traceCacheEvict(cacheDir, limit);
+}
@@ -0,0 +1,39 @@
+#ifndef TRACE_CACHE_H
+#define TRACE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "trace.h"
+
+// Output format of the simulator, part of every cache key
+// Bump it whenever the output for the same trace and options changes
+#define TRACE_CACHE_VERSION 1
+
+// Content address of a run's output
+typedef struct {
+    uint64_t words[2]; // 128-bit hash of the trace, scheduler, options, version and executable
+} trace_cache_key_t;
+
+// Computes the cache key of a run
+// traceFilename - path to trace file, hashed by content
+// schedulerName - name of scheduler with its parameters
+// options - trace run options, only those that change the output are hashed
+// key - set to the cache key
+// Returns true on success, false if the trace or the running executable could not be read
+bool traceCacheKey(const char* traceFilename, const char* schedulerName, const trace_options_t* options, trace_cache_key_t* key);
+
+// Copies a cached output to the output file
+// cacheDir - cache directory
+// key - cache key of the run
+// outFilename - path to output file
+// Returns true if the output was cached and copied, false otherwise
+bool traceCacheFetch(const char* cacheDir, const trace_cache_key_t* key, const char* outFilename);
+
+// Adds a run's output to the cache and evicts the least recently used outputs
+// cacheDir - cache directory, created if missing
+// key - cache key of the run
+// outFilename - path to output file
+// limit - total size in bytes the cached outputs are trimmed to
+void traceCacheStore(const char* cacheDir, const trace_cache_key_t* key, const char* outFilename, uint64_t limit);
+
+#endif /* TRACE_CACHE_H */
@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "traceGzip.h"
+
+// Compressed traces
+//
+// A gzip trace is read through a stdio stream over its decompressed contents, so
+// every engine and the prefetcher read it like a plain file. Plain gzip files are
+// inflated as they are read, restarting at every member of a multi-member file.
+//
+// BGZF files are gzip files made of independent members of at most 64KiB, each
+// recording its compressed size in a "BC" extra field, so the members can be found
+// without inflating them. Worker threads take turns reading the next member into a
+// ring of slots and inflate their member outside the lock; the stream hands out the
+// slots in file order as they become ready, so decompression runs ahead of parsing
+// on all threads.
+
+// Bytes read from the compressed file at a time when streaming
+#define TRACE_GZIP_CHUNK (1 << 16)
+
+// Ring slots per decompression thread
+#define TRACE_GZIP_SLOTS_PER_THREAD 4
+
+// Size of the gzip header fields up to and including XLEN
+#define TRACE_GZIP_HEADER 12
+
+// Largest BGZF member
+#define TRACE_GZIP_MAX_BLOCK (1 << 16)
+
+// Streaming decompression of a plain gzip file
+typedef struct {
+    FILE* file; // compressed file
+    z_stream stream; // inflate state
+    unsigned char* in; // compressed input
+    bool end; // reached the end of the compressed file
+    bool inMember; // part of a member was inflated
+} trace_gzip_stream_t;
+
+typedef enum {
+    TRACE_GZIP_EMPTY, // free for the next member
+    TRACE_GZIP_BUSY, // member read, being inflated
+    TRACE_GZIP_READY // inflated, waiting to be read
+} trace_gzip_slot_state_t;
+
+// BGZF member in the ring
+typedef struct {
+    trace_gzip_slot_state_t state; // slot state
+    unsigned char in[TRACE_GZIP_MAX_BLOCK]; // compressed member
+    size_t inSize; // size of the compressed member
+    unsigned char out[TRACE_GZIP_MAX_BLOCK]; // decompressed member
+    size_t outSize; // size of the decompressed member
+} trace_gzip_slot_t;
+
+// Parallel decompression of a BGZF file
+typedef struct {
+    FILE* file; // compressed file
+    trace_gzip_slot_t* slots; // ring of members
+    size_t numSlots; // number of slots
+    pthread_t* threads; // decompression threads
+    size_t numThreads; // number of threads
+    pthread_mutex_t lock; // guards everything below and reading the file
+    pthread_cond_t changed; // signaled whenever a slot changes state
+    uint64_t nextFill; // sequence number of the next member to read
+    uint64_t nextRead; // sequence number of the member being consumed
+    size_t readOffset; // bytes consumed of that member
+    bool end; // all members were read from the file
+    bool failed; // a member was malformed
+    bool stop; // the stream is being closed
+} trace_gzip_parallel_t;
+
+// Returns true if a file starts with the gzip magic bytes
+// The file position is left at the start of the file
+bool traceGzipDetect(FILE* file)
+{
+    unsigned char magic[2];
+    size_t length = fread(magic, 1, sizeof(magic), file);
+    rewind(file);
+    return length == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// Reports corrupt compressed data
+// The read fails like any other trace read error, so flush the message right away
+static void traceGzipCorrupt(const char* reason)
+{
+    printf("Corrupt compressed trace: %s\n", reason);
+    fflush(stdout);
+}
+
+// Reads decompressed bytes of a plain gzip file
+static ssize_t traceGzipStreamRead(void* cookie, char* buffer, size_t size)
+{
+    trace_gzip_stream_t* gzip = (trace_gzip_stream_t*)cookie;
+    gzip->stream.next_out = (unsigned char*)buffer;
+    gzip->stream.avail_out = (uInt)(size < UINT32_MAX ? size : UINT32_MAX);
+    while (gzip->stream.avail_out > 0) {
+        if (gzip->stream.avail_in == 0 && !gzip->end) {
+            gzip->stream.next_in = gzip->in;
+            gzip->stream.avail_in = (uInt)fread(gzip->in, 1, TRACE_GZIP_CHUNK, gzip->file);
+            gzip->end = gzip->stream.avail_in == 0;
+        }
+        if (gzip->stream.avail_in == 0) {
+            if (gzip->inMember) {
+                traceGzipCorrupt("truncated");
+                return -1;
+            }
+            break;
+        }
+        gzip->inMember = true;
+        int ret = inflate(&gzip->stream, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            // Another member may follow
+            inflateReset(&gzip->stream);
+            gzip->inMember = false;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            traceGzipCorrupt(gzip->stream.msg ? gzip->stream.msg : "invalid data");
+            return -1;
+        }
+    }
+    return (ssize_t)(size - gzip->stream.avail_out);
+}
+
+// Closes a plain gzip stream
+static int traceGzipStreamClose(void* cookie)
+{
+    trace_gzip_stream_t* gzip = (trace_gzip_stream_t*)cookie;
+    inflateEnd(&gzip->stream);
+    int ret = fclose(gzip->file);
+    free(gzip->in);
+    free(gzip);
+    return ret;
+}
+
+// Reads the next BGZF member into a slot, called with the lock held
+// Returns 1 if a member was read, 0 at the end of the file, -1 if it is malformed
+static int traceGzipReadBlock(FILE* file, trace_gzip_slot_t* slot)
+{
+    unsigned char* header = slot->in;
+    size_t length = fread(header, 1, TRACE_GZIP_HEADER, file);
+    if (length == 0) {
+        return 0;
+    }
+    if (length != TRACE_GZIP_HEADER || header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 0x04)) {
+        return -1;
+    }
+    size_t extraLength = (size_t)header[10] | (size_t)header[11] << 8;
+    if (TRACE_GZIP_HEADER + extraLength > TRACE_GZIP_MAX_BLOCK ||
+        fread(header + TRACE_GZIP_HEADER, 1, extraLength, file) != extraLength) {
+        return -1;
+    }
+    // Find the BC subfield with the member size
+    size_t blockSize = 0;
+    for (size_t pos = TRACE_GZIP_HEADER; pos + 4 <= TRACE_GZIP_HEADER + extraLength;) {
+        size_t fieldLength = (size_t)header[pos + 2] | (size_t)header[pos + 3] << 8;
+        if (header[pos] == 'B' && header[pos + 1] == 'C' && fieldLength == 2 && pos + 6 <= TRACE_GZIP_HEADER + extraLength) {
+            blockSize = ((size_t)header[pos + 4] | (size_t)header[pos + 5] << 8) + 1;
+        }
+        pos += 4 + fieldLength;
+    }
+    size_t headerLength = TRACE_GZIP_HEADER + extraLength;
+    if (blockSize <= headerLength || fread(slot->in + headerLength, 1, blockSize - headerLength, file) != blockSize - headerLength) {
+        return -1;
+    }
+    slot->inSize = blockSize;
+    return 1;
+}
+
+// Inflates the member in a slot
+// Returns true on success, false otherwise
+static bool traceGzipInflateBlock(trace_gzip_slot_t* slot)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = slot->in;
+    stream.avail_in = (uInt)slot->inSize;
+    stream.next_out = slot->out;
+    stream.avail_out = sizeof(slot->out);
+    int ret = inflate(&stream, Z_FINISH);
+    slot->outSize = sizeof(slot->out) - stream.avail_out;
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END;
+}
+
+// Decompression thread, reads and inflates members until the end of the file
+static void* traceGzipThread(void* p)
+{
+    trace_gzip_parallel_t* gzip = (trace_gzip_parallel_t*)p;
+    pthread_mutex_lock(&gzip->lock);
+    for (;;) {
+        while (!gzip->stop && !gzip->end && !gzip->failed && gzip->slots[gzip->nextFill % gzip->numSlots].state != TRACE_GZIP_EMPTY) {
+            pthread_cond_wait(&gzip->changed, &gzip->lock);
+        }
+        if (gzip->stop || gzip->end || gzip->failed) {
+            break;
+        }
+        trace_gzip_slot_t* slot = &gzip->slots[gzip->nextFill % gzip->numSlots];
+        int status = traceGzipReadBlock(gzip->file, slot);
+        if (status <= 0) {
+            gzip->end = true;
+            gzip->failed = status < 0;
+            pthread_cond_broadcast(&gzip->changed);
+            break;
+        }
+        slot->state = TRACE_GZIP_BUSY;
+        gzip->nextFill++;
+        pthread_mutex_unlock(&gzip->lock);
+        bool inflated = traceGzipInflateBlock(slot);
+        pthread_mutex_lock(&gzip->lock);
+        slot->state = TRACE_GZIP_READY;
+        gzip->failed = gzip->failed || !inflated;
+        pthread_cond_broadcast(&gzip->changed);
+    }
+    pthread_mutex_unlock(&gzip->lock);
+    return NULL;
+}
+
+// Reads decompressed bytes of a BGZF file in member order
+static ssize_t traceGzipParallelRead(void* cookie, char* buffer, size_t size)
+{
+    trace_gzip_parallel_t* gzip = (trace_gzip_parallel_t*)cookie;
+    size_t copied = 0;
+    pthread_mutex_lock(&gzip->lock);
+    while (copied < size) {
+        trace_gzip_slot_t* slot = &gzip->slots[gzip->nextRead % gzip->numSlots];
+        while (!gzip->failed && slot->state != TRACE_GZIP_READY && !(gzip->end && gzip->nextRead == gzip->nextFill)) {
+            pthread_cond_wait(&gzip->changed, &gzip->lock);
+        }
+        if (gzip->failed) {
+            pthread_mutex_unlock(&gzip->lock);
+            traceGzipCorrupt("invalid BGZF member");
+            return -1;
+        }
+        if (slot->state != TRACE_GZIP_READY) {
+            break;
+        }
+        size_t length = slot->outSize - gzip->readOffset;
+        if (length > size - copied) {
+            length = size - copied;
+        }
+        memcpy(buffer + copied, slot->out + gzip->readOffset, length);
+        copied += length;
+        gzip->readOffset += length;
+        if (gzip->readOffset == slot->outSize) {
+            slot->state = TRACE_GZIP_EMPTY;
+            gzip->nextRead++;
+            gzip->readOffset = 0;
+            pthread_cond_broadcast(&gzip->changed);
+        }
+    }
+    pthread_mutex_unlock(&gzip->lock);
+    return (ssize_t)copied;
+}
+
+// Stops the decompression threads and frees a BGZF stream, the file stays open
+static void traceGzipParallelStop(trace_gzip_parallel_t* gzip)
+{
+    pthread_mutex_lock(&gzip->lock);
+    gzip->stop = true;
+    pthread_cond_broadcast(&gzip->changed);
+    pthread_mutex_unlock(&gzip->lock);
+    for (size_t i = 0; i < gzip->numThreads; i++) {
+        pthread_join(gzip->threads[i], NULL);
+    }
+    pthread_cond_destroy(&gzip->changed);
+    pthread_mutex_destroy(&gzip->lock);
+    free(gzip->threads);
+    free(gzip->slots);
+    free(gzip);
+}
+
+// Closes a BGZF stream
+static int traceGzipParallelClose(void* cookie)
+{
+    trace_gzip_parallel_t* gzip = (trace_gzip_parallel_t*)cookie;
+    FILE* file = gzip->file;
+    traceGzipParallelStop(gzip);
+    return fclose(file);
+}
+
+// Returns true if the first member of a gzip file has a BGZF size field
+// The file position is left at the start of the file
+static bool traceGzipIsBgzf(FILE* file)
+{
+    unsigned char header[TRACE_GZIP_HEADER + 6];
+    size_t length = fread(header, 1, sizeof(header), file);
+    rewind(file);
+    return length == sizeof(header) && (header[3] & 0x04) && header[10] == 6 && header[11] == 0 &&
+           header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+}
+
+// Opens a BGZF stream decompressed by parallel threads
+// Returns the stream or NULL on failure
+static FILE* traceGzipOpenParallel(FILE* file, size_t numThreads)
+{
+    trace_gzip_parallel_t* gzip = calloc(1, sizeof(trace_gzip_parallel_t));
+    if (gzip == NULL) {
+        return NULL;
+    }
+    gzip->file = file;
+    gzip->numSlots = numThreads * TRACE_GZIP_SLOTS_PER_THREAD;
+    gzip->slots = calloc(gzip->numSlots, sizeof(trace_gzip_slot_t));
+    gzip->threads = malloc(numThreads * sizeof(pthread_t));
+    if (gzip->slots == NULL || gzip->threads == NULL) {
+        free(gzip->slots);
+        free(gzip->threads);
+        free(gzip);
+        return NULL;
+    }
+    pthread_mutex_init(&gzip->lock, NULL);
+    pthread_cond_init(&gzip->changed, NULL);
+    for (; gzip->numThreads < numThreads; gzip->numThreads++) {
+        if (pthread_create(&gzip->threads[gzip->numThreads], NULL, traceGzipThread, gzip) != 0) {
+            break;
+        }
+    }
+    cookie_io_functions_t functions = {.read = traceGzipParallelRead, .write = NULL, .seek = NULL, .close = traceGzipParallelClose};
+    FILE* stream = gzip->numThreads > 0 ? fopencookie(gzip, "r", functions) : NULL;
+    if (stream == NULL) {
+        traceGzipParallelStop(gzip);
+    }
+    return stream;
+}
+
+// Opens a stream of the decompressed contents of a gzip file
+// Multi-member files are read member after member. BGZF files, whose members carry
+// their compressed size, are decompressed by numThreads threads in parallel when
+// numThreads is larger than one.
+// file - gzip file positioned at its start, closed with the returned stream
+// numThreads - number of decompression threads for BGZF files
+// Returns the stream or NULL on failure, in which case the file is not closed
+FILE* traceGzipOpen(FILE* file, size_t numThreads)
+{
+    if (numThreads > 1 && traceGzipIsBgzf(file)) {
+        return traceGzipOpenParallel(file, numThreads);
+    }
+    trace_gzip_stream_t* gzip = calloc(1, sizeof(trace_gzip_stream_t));
+    if (gzip == NULL) {
+        return NULL;
+    }
+    gzip->file = file;
+    gzip->in = malloc(TRACE_GZIP_CHUNK);
+    // Accept gzip headers only, with the largest window
+    if (gzip->in == NULL || inflateInit2(&gzip->stream, 16 + MAX_WBITS) != Z_OK) {
+        free(gzip->in);
+        free(gzip);
+        return NULL;
+    }
+    cookie_io_functions_t functions = {.read = traceGzipStreamRead, .write = NULL, .seek = NULL, .close = traceGzipStreamClose};
+    FILE* stream = fopencookie(gzip, "r", functions);
+    if (stream == NULL) {
+        inflateEnd(&gzip->stream);
+        free(gzip->in);
+        free(gzip);
+    }
+    return stream;
+}
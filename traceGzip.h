@@ -0,0 +1,21 @@
+#ifndef TRACE_GZIP_H
+#define TRACE_GZIP_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Returns true if a file starts with the gzip magic bytes
+// The file position is left at the start of the file
+bool traceGzipDetect(FILE* file);
+
+// Opens a stream of the decompressed contents of a gzip file
+// Multi-member files are read member after member. BGZF files, whose members carry
+// their compressed size, are decompressed by numThreads threads in parallel when
+// numThreads is larger than one.
+// file - gzip file positioned at its start, closed with the returned stream
+// numThreads - number of decompression threads for BGZF files
+// Returns the stream or NULL on failure, in which case the file is not closed
+FILE* traceGzipOpen(FILE* file, size_t numThreads);
+
+#endif /* TRACE_GZIP_H */
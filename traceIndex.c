@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "trace.h"
+#include "traceIndex.h"
+
+// Sparse time index
+//
+// Simulating a window of a long trace only needs the jobs from the last moment the
+// system was empty before the window: the state of a single queue is empty at that
+// moment whatever happened before it, so a run from there completes the window's
+// jobs exactly as a run from the start of the trace. Such a moment is the arrival of
+// a job after all earlier work is done (the previous completion happens first), and
+// for every scheduler it is the same, since every scheduler keeps the server busy
+// while there is work.
+//
+// The sidecar index marks the first busy period start in every TRACE_INDEX_STRIDE
+// bytes of the trace with its arrival time and byte offset. A lookup takes the last
+// marker at or before the window and scans forward from it to the last busy period
+// start before the window, so it reads at most a stride plus the busy period the
+// window starts in. The index records the size and modification time of the trace
+// and is rebuilt when either changes.
+
+// Bytes of trace per index marker
+#define TRACE_INDEX_STRIDE (1 << 18)
+
+// Bytes read from the trace at a time when scanning
+#define TRACE_INDEX_CHUNK (1 << 16)
+
+// Sidecar index file header
+typedef struct {
+    char magic[4]; // "TIDX"
+    uint32_t version; // TRACE_INDEX_VERSION
+    uint64_t traceSize; // size of the indexed trace in bytes
+    int64_t traceModified; // modification time of the indexed trace in nanoseconds
+    uint64_t numEntries; // number of markers following the header
+} trace_index_header_t;
+
+// Busy period start marker
+typedef struct {
+    uint64_t arrivalTime; // arrival time of the job starting the busy period
+    uint64_t offset; // byte offset of the job's record
+} trace_index_entry_t;
+
+// Record scanner over a trace file
+typedef struct {
+    FILE* file; // trace file
+    char* buffer; // text read from the file
+    size_t length; // bytes in the buffer
+    size_t pos; // parse position in the buffer
+    size_t lineEnd; // end of the last complete line in the buffer
+    uint64_t base; // file offset of the start of the buffer
+    bool eof; // the whole file was read
+} trace_index_scanner_t;
+
+// Tracks the outstanding work of the jobs scanned so far
+typedef struct {
+    uint64_t busyUntil; // time at which all work scanned so far is done
+    uint64_t lastArrival; // arrival time of the last job scanned
+    bool started; // a job was scanned
+} trace_index_work_t;
+
+// Opens a scanner at a byte offset of a trace file
+// Returns true on success, false otherwise
+static bool traceIndexScanOpen(trace_index_scanner_t* scanner, const char* traceFilename, uint64_t offset)
+{
+    scanner->file = fopen(traceFilename, "r");
+    scanner->buffer = malloc(TRACE_INDEX_CHUNK);
+    scanner->length = 0;
+    scanner->pos = 0;
+    scanner->lineEnd = 0;
+    scanner->base = offset;
+    scanner->eof = false;
+    if (scanner->file == NULL || scanner->buffer == NULL || fseeko(scanner->file, (off_t)offset, SEEK_SET) != 0) {
+        if (scanner->file) {
+            fclose(scanner->file);
+        }
+        free(scanner->buffer);
+        return false;
+    }
+    return true;
+}
+
+// Closes a scanner
+// Returns true if the file was read without errors, false otherwise
+static bool traceIndexScanClose(trace_index_scanner_t* scanner)
+{
+    bool success = !ferror(scanner->file);
+    fclose(scanner->file);
+    free(scanner->buffer);
+    return success;
+}
+
+// Moves the unparsed text to the start of the buffer and reads more
+// Returns false if no more text could be read
+static bool traceIndexScanFill(trace_index_scanner_t* scanner)
+{
+    if (scanner->eof || (scanner->pos == 0 && scanner->length == TRACE_INDEX_CHUNK)) {
+        // A line longer than the buffer is not a record
+        return false;
+    }
+    memmove(scanner->buffer, scanner->buffer + scanner->pos, scanner->length - scanner->pos);
+    scanner->base += scanner->pos;
+    scanner->length -= scanner->pos;
+    scanner->pos = 0;
+    scanner->length += fread(scanner->buffer + scanner->length, 1, TRACE_INDEX_CHUNK - scanner->length, scanner->file);
+    scanner->eof = scanner->length < TRACE_INDEX_CHUNK;
+    // Only complete lines are parsed, except at the end of the file
+    scanner->lineEnd = scanner->length;
+    while (!scanner->eof && scanner->lineEnd > 0 && scanner->buffer[scanner->lineEnd - 1] != '\n') {
+        scanner->lineEnd--;
+    }
+    return true;
+}
+
+// Scans the next record
+// offset - set to the byte offset of the record
+// Returns true if a record was scanned, false at the end of the records
+static bool traceIndexScanNext(trace_index_scanner_t* scanner, uint64_t* offset, uint64_t* arrivalTime, uint64_t* jobTime)
+{
+    for (;;) {
+        const char* start = scanner->buffer + scanner->pos;
+        const char* end = scanner->buffer + scanner->lineEnd;
+        const char* text = start;
+        while (text < end && isspace((unsigned char)*text)) {
+            text++;
+        }
+        if (text < end) {
+            uint64_t id;
+            const char* next = traceParseJob(start, end, &id, arrivalTime, jobTime);
+            if (next == NULL) {
+                // Malformed record, the trace ends here as with fscanf
+                return false;
+            }
+            *offset = scanner->base + scanner->pos;
+            scanner->pos = (size_t)(next - scanner->buffer);
+            return true;
+        }
+        scanner->pos = scanner->lineEnd;
+        if (!traceIndexScanFill(scanner)) {
+            return false;
+        }
+    }
+}
+
+// Adds a scanned job to the outstanding work
+// Returns true if the job starts a busy period, false otherwise
+static inline bool traceIndexWorkAdd(trace_index_work_t* work, uint64_t arrivalTime, uint64_t jobTime)
+{
+    // Jobs arriving together are taken at once by some schedulers, so a busy period
+    // starts only with the first of them
+    bool busyStart = !work->started || (arrivalTime >= work->busyUntil && arrivalTime != work->lastArrival);
+    work->busyUntil = (arrivalTime > work->busyUntil ? arrivalTime : work->busyUntil) + jobTime;
+    work->lastArrival = arrivalTime;
+    work->started = true;
+    return busyStart;
+}
+
+// Builds the path of the sidecar index of a trace
+// Returns the path, to be freed by the caller, or NULL on failure
+static char* traceIndexPath(const char* traceFilename)
+{
+    size_t len = strlen(traceFilename) + sizeof(".tidx");
+    char* path = malloc(len);
+    if (path != NULL) {
+        snprintf(path, len, "%s.tidx", traceFilename);
+    }
+    return path;
+}
+
+// Loads the sidecar index of a trace if it is up to date
+// header - expected header, numEntries is set from the index
+// Returns the markers, to be freed by the caller, or NULL if there is no usable index
+static trace_index_entry_t* traceIndexLoad(const char* path, trace_index_header_t* header)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    trace_index_header_t stored;
+    trace_index_entry_t* entries = NULL;
+    if (fread(&stored, sizeof(stored), 1, file) == 1 && memcmp(stored.magic, header->magic, sizeof(stored.magic)) == 0 &&
+        stored.version == header->version && stored.traceSize == header->traceSize &&
+        stored.traceModified == header->traceModified && stored.numEntries > 0 && stored.numEntries <= header->traceSize) {
+        entries = malloc(stored.numEntries * sizeof(trace_index_entry_t));
+        if (entries != NULL && fread(entries, sizeof(trace_index_entry_t), stored.numEntries, file) != stored.numEntries) {
+            free(entries);
+            entries = NULL;
+        }
+        header->numEntries = stored.numEntries;
+    }
+    fclose(file);
+    return entries;
+}
+
+// Writes the sidecar index of a trace
+// It is written to a temporary file and renamed into place, so concurrent runs
+// never read a partial index; failing to write it only costs the next run a rebuild
+static void traceIndexSave(const char* path, const trace_index_header_t* header, const trace_index_entry_t* entries)
+{
+    size_t len = strlen(path) + 32;
+    char* tmpPath = malloc(len);
+    if (tmpPath == NULL) {
+        return;
+    }
+    snprintf(tmpPath, len, "%s.%ld.tmp", path, (long)getpid());
+    FILE* file = fopen(tmpPath, "w");
+    if (file != NULL) {
+        bool success = fwrite(header, sizeof(*header), 1, file) == 1 &&
+                       fwrite(entries, sizeof(trace_index_entry_t), header->numEntries, file) == header->numEntries;
+        if (fclose(file) != 0 || !success || rename(tmpPath, path) != 0) {
+            unlink(tmpPath);
+        }
+    }
+    free(tmpPath);
+}
+
+// Builds the index of a trace by scanning all of it
+// header - numEntries is set to the number of markers
+// Returns the markers, to be freed by the caller, or NULL on failure
+static trace_index_entry_t* traceIndexBuild(const char* traceFilename, trace_index_header_t* header)
+{
+    trace_index_scanner_t scanner;
+    if (!traceIndexScanOpen(&scanner, traceFilename, 0)) {
+        return NULL;
+    }
+    // The first marker is at the start, so every window has one at or before it
+    size_t capacity = 64;
+    trace_index_entry_t* entries = malloc(capacity * sizeof(trace_index_entry_t));
+    if (entries == NULL) {
+        traceIndexScanClose(&scanner);
+        return NULL;
+    }
+    entries[0].arrivalTime = 0;
+    entries[0].offset = 0;
+    size_t numEntries = 1;
+    trace_index_work_t work = {0, 0, false};
+    uint64_t nextMark = TRACE_INDEX_STRIDE;
+    uint64_t offset;
+    uint64_t arrivalTime;
+    uint64_t jobTime;
+    while (traceIndexScanNext(&scanner, &offset, &arrivalTime, &jobTime)) {
+        if (!traceIndexWorkAdd(&work, arrivalTime, jobTime) || offset < nextMark) {
+            continue;
+        }
+        if (numEntries == capacity) {
+            capacity *= 2;
+            trace_index_entry_t* grown = realloc(entries, capacity * sizeof(trace_index_entry_t));
+            if (grown == NULL) {
+                traceIndexScanClose(&scanner);
+                free(entries);
+                return NULL;
+            }
+            entries = grown;
+        }
+        entries[numEntries].arrivalTime = arrivalTime;
+        entries[numEntries].offset = offset;
+        numEntries++;
+        nextMark = (offset / TRACE_INDEX_STRIDE + 1) * TRACE_INDEX_STRIDE;
+    }
+    if (!traceIndexScanClose(&scanner)) {
+        free(entries);
+        return NULL;
+    }
+    header->numEntries = numEntries;
+    return entries;
+}
+
+// Finds where a run over a time window starts reading a trace
+// The jobs from the returned offset on are simulated from an empty system, so the
+// offset is the last moment at or before the window where all earlier work is done.
+// The sidecar index traceFilename.tidx is built on first use and rebuilt whenever
+// the trace changes.
+// traceFilename - path to an uncompressed trace file
+// fromTime - start of the time window
+// offset - set to the byte offset to start reading at
+// Returns true on success, false if the trace could not be read
+bool traceIndexFind(const char* traceFilename, uint64_t fromTime, uint64_t* offset)
+{
+    struct stat status;
+    char* path = traceIndexPath(traceFilename);
+    if (path == NULL || stat(traceFilename, &status) != 0) {
+        free(path);
+        return false;
+    }
+    trace_index_header_t header = {
+        .magic = {'T', 'I', 'D', 'X'},
+        .version = TRACE_INDEX_VERSION,
+        .traceSize = (uint64_t)status.st_size,
+        .traceModified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec,
+        .numEntries = 0,
+    };
+    trace_index_entry_t* entries = traceIndexLoad(path, &header);
+    if (entries == NULL) {
+        entries = traceIndexBuild(traceFilename, &header);
+        if (entries != NULL) {
+            traceIndexSave(path, &header, entries);
+        }
+    }
+    free(path);
+    if (entries == NULL) {
+        return false;
+    }
+    // Last marker at or before the window, the first one is at the start
+    size_t low = 0;
+    size_t high = header.numEntries;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].arrivalTime <= fromTime) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    *offset = entries[low].offset;
+    free(entries);
+    // Scan to the last busy period start at or before the window, or to the first job
+    // after the window's start if it starts a busy period and no job arrives at the start
+    trace_index_scanner_t scanner;
+    if (!traceIndexScanOpen(&scanner, traceFilename, *offset)) {
+        return false;
+    }
+    trace_index_work_t work = {0, 0, false};
+    uint64_t recordOffset;
+    uint64_t arrivalTime;
+    uint64_t jobTime;
+    while (traceIndexScanNext(&scanner, &recordOffset, &arrivalTime, &jobTime)) {
+        bool emptyBefore = !work.started || work.lastArrival < fromTime;
+        if (traceIndexWorkAdd(&work, arrivalTime, jobTime) && (arrivalTime <= fromTime || emptyBefore)) {
+            *offset = recordOffset;
+        }
+        if (arrivalTime > fromTime) {
+            break;
+        }
+    }
+    return traceIndexScanClose(&scanner);
+}
@@ -0,0 +1,21 @@
+#ifndef TRACE_INDEX_H
+#define TRACE_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Format of the sidecar index, indexes of other versions are rebuilt
+#define TRACE_INDEX_VERSION 1
+
+// Finds where a run over a time window starts reading a trace
+// The jobs from the returned offset on are simulated from an empty system, so the
+// offset is the last moment at or before the window where all earlier work is done.
+// The sidecar index traceFilename.tidx is built on first use and rebuilt whenever
+// the trace changes.
+// traceFilename - path to an uncompressed trace file
+// fromTime - start of the time window
+// offset - set to the byte offset to start reading at
+// Returns true on success, false if the trace could not be read
+bool traceIndexFind(const char* traceFilename, uint64_t fromTime, uint64_t* offset);
+
+#endif /* TRACE_INDEX_H */